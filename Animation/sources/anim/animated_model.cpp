@@ -0,0 +1,254 @@
+#include "animated_model.h"
+#include "pose.h"
+#include <algorithm>
+#include <assimp/scene.h>
+#include <assimp/Importer.hpp>
+#include <log.h>
+
+constexpr float AnimationSampleRate = 30.f;
+
+static aiMatrix4x4 global_transform(const aiNode *node)
+{
+  aiMatrix4x4 transform;
+  for (; node; node = node->mParent)
+    transform = node->mTransformation * transform;
+  return transform;
+}
+
+static const aiNode *find_mesh_node(const aiNode *node, unsigned idx)
+{
+  for (unsigned i = 0; i < node->mNumMeshes; i++)
+    if (node->mMeshes[i] == idx)
+      return node;
+  for (unsigned i = 0; i < node->mNumChildren; i++)
+    if (const aiNode *meshNode = find_mesh_node(node->mChildren[i], idx))
+      return meshNode;
+  return nullptr;
+}
+
+//the highest node under the scene root which contains bones
+static const aiNode *find_skeleton_root(const aiScene *scene, const aiMesh *mesh)
+{
+  const aiNode *root = scene->mRootNode->FindNode(mesh->mBones[0]->mName);
+  if (!root)
+    return nullptr;
+  while (root->mParent && root->mParent != scene->mRootNode)
+    root = root->mParent;
+  return root;
+}
+
+static void add_joints(Skeleton &skeleton, const aiNode *node, int parent, const aiMatrix4x4 &parent_transform)
+{
+  aiVector3D scale, position;
+  aiQuaternion rotation;
+  (parent_transform * node->mTransformation).Decompose(scale, rotation, position);
+
+  int joint = skeleton.joint_count();
+  skeleton.names.emplace_back(node->mName.C_Str());
+  skeleton.parents.push_back(parent);
+  skeleton.bindTranslations.push_back(to_vec3(position));
+  skeleton.bindRotations.push_back(to_quat(rotation));
+  skeleton.bindScales.push_back(to_vec3(scale));
+
+  for (unsigned i = 0; i < node->mNumChildren; i++)
+    add_joints(skeleton, node->mChildren[i], joint, aiMatrix4x4());
+}
+
+static SkeletonPtr create_skeleton(const aiNode *root, const aiMesh *mesh, const aiMatrix4x4 &root_parent_transform, const mat4 &mesh_transform)
+{
+  auto skeleton = std::make_shared<Skeleton>();
+  add_joints(*skeleton, root, -1, root_parent_transform);
+
+  int n = skeleton->joint_count();
+  std::vector<mat4> bindPose(n);
+  skeleton->inverseBindPose.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    mat4 local = compose_transform(skeleton->bindTranslations[i], skeleton->bindRotations[i], skeleton->bindScales[i]);
+    int parent = skeleton->parents[i];
+    bindPose[i] = parent >= 0 ? bindPose[parent] * local : local;
+    skeleton->inverseBindPose[i] = inverse(bindPose[i]) * mesh_transform;
+  }
+  //bones know exact mesh space bind pose
+  for (unsigned i = 0; i < mesh->mNumBones; i++)
+  {
+    const aiBone *bone = mesh->mBones[i];
+    int joint = skeleton->find_joint(bone->mName.C_Str());
+    if (joint >= 0)
+      skeleton->inverseBindPose[joint] = to_mat4(bone->mOffsetMatrix);
+  }
+  skeleton->lodJointCount[0] = n;
+  return skeleton;
+}
+
+template<typename Key>
+static unsigned find_next_key(const Key *keys, unsigned count, double tick)
+{
+  return std::upper_bound(keys, keys + count, tick, [](double t, const Key &key) { return t < key.mTime; }) - keys;
+}
+
+static vec3 sample_keys(const aiVectorKey *keys, unsigned count, double tick)
+{
+  unsigned i = find_next_key(keys, count, tick);
+  if (i == 0 || i == count)
+    return to_vec3(keys[i == 0 ? 0 : count - 1].mValue);
+  float t = float((tick - keys[i - 1].mTime) / (keys[i].mTime - keys[i - 1].mTime));
+  return mix(to_vec3(keys[i - 1].mValue), to_vec3(keys[i].mValue), t);
+}
+
+static quat sample_keys(const aiQuatKey *keys, unsigned count, double tick)
+{
+  unsigned i = find_next_key(keys, count, tick);
+  if (i == 0 || i == count)
+    return to_quat(keys[i == 0 ? 0 : count - 1].mValue);
+  float t = float((tick - keys[i - 1].mTime) / (keys[i].mTime - keys[i - 1].mTime));
+  return slerp(to_quat(keys[i - 1].mValue), to_quat(keys[i].mValue), t);
+}
+
+static void decompose_transform(const mat4 &transform, vec3 &translation, quat &rotation, vec3 &scale)
+{
+  translation = vec3(transform[3]);
+  scale = vec3(length(vec3(transform[0])), length(vec3(transform[1])), length(vec3(transform[2])));
+  rotation = quat_cast(mat3(vec3(transform[0]) / scale.x, vec3(transform[1]) / scale.y, vec3(transform[2]) / scale.z));
+}
+
+static AnimationClipPtr create_animation(const aiAnimation *animation, const Skeleton &skeleton, const mat4 &root_parent_transform)
+{
+  double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+  int n = skeleton.joint_count();
+
+  auto clip = std::make_shared<AnimationClip>();
+  clip->name = animation->mName.C_Str();
+  clip->duration = float(animation->mDuration / ticksPerSecond);
+  clip->frameCount = glm::max(int(clip->duration * AnimationSampleRate + 0.5f), 1) + 1;
+  clip->sampleRate = clip->duration > 0.f ? (clip->frameCount - 1) / clip->duration : AnimationSampleRate;
+  clip->jointCount = n;
+  clip->translations.resize(clip->frameCount * n);
+  clip->rotations.resize(clip->frameCount * n);
+  clip->scales.resize(clip->frameCount * n);
+
+  for (int frame = 0; frame < clip->frameCount; frame++)
+  {
+    std::copy(skeleton.bindTranslations.begin(), skeleton.bindTranslations.end(), clip->translations.begin() + frame * n);
+    std::copy(skeleton.bindRotations.begin(), skeleton.bindRotations.end(), clip->rotations.begin() + frame * n);
+    std::copy(skeleton.bindScales.begin(), skeleton.bindScales.end(), clip->scales.begin() + frame * n);
+  }
+
+  for (unsigned i = 0; i < animation->mNumChannels; i++)
+  {
+    const aiNodeAnim *channel = animation->mChannels[i];
+    int joint = skeleton.find_joint(channel->mNodeName.C_Str());
+    if (joint < 0)
+      continue;
+
+    for (int frame = 0; frame < clip->frameCount; frame++)
+    {
+      double tick = frame / clip->sampleRate * ticksPerSecond;
+      vec3 &translation = clip->translations[frame * n + joint];
+      quat &rotation = clip->rotations[frame * n + joint];
+      vec3 &scale = clip->scales[frame * n + joint];
+      if (channel->mNumPositionKeys)
+        translation = sample_keys(channel->mPositionKeys, channel->mNumPositionKeys, tick);
+      if (channel->mNumRotationKeys)
+        rotation = sample_keys(channel->mRotationKeys, channel->mNumRotationKeys, tick);
+      if (channel->mNumScalingKeys)
+        scale = sample_keys(channel->mScalingKeys, channel->mNumScalingKeys, tick);
+
+      //root bind pose already contains transforms of nodes above the skeleton
+      if (skeleton.parents[joint] < 0)
+        decompose_transform(root_parent_transform * compose_transform(translation, rotation, scale), translation, rotation, scale);
+    }
+  }
+  return clip;
+}
+
+static BoundingBox compute_clip_bounds(const AnimationClip &clip, const Skeleton &skeleton, const JointBounds &joint_bounds)
+{
+  int n = skeleton.joint_count();
+  Pose pose;
+  pose.resize(n);
+  std::vector<mat4> model(n), palette(n);
+  BoundingBox bounds;
+  for (int frame = 0; frame < clip.frameCount; frame++)
+  {
+    sample_animation(clip, frame / clip.sampleRate, n, pose);
+    local_to_model(skeleton, pose, n, model.data());
+    model_to_palette(skeleton, model.data(), n, palette.data());
+    bounds.add(skinned_bounds(joint_bounds, mat4(1.f), palette.data()));
+  }
+  return bounds;
+}
+
+AnimatedModelPtr load_animated_model(
+  const char *path,
+  int idx,
+  const SkeletonLodSettings &lod_settings,
+  const RootMotionSettings &root_motion_settings)
+{
+  Assimp::Importer importer;
+  const aiScene *scene = import_scene(importer, path);
+  if (!scene)
+  {
+    debug_error("no asset in %s", path);
+    return nullptr;
+  }
+  const aiMesh *mesh = scene->mMeshes[idx];
+  const aiNode *root = mesh->HasBones() ? find_skeleton_root(scene, mesh) : nullptr;
+  if (!root)
+  {
+    debug_error("mesh %d in %s doesn't have skeleton", idx, path);
+    return nullptr;
+  }
+
+  const aiNode *meshNode = find_mesh_node(scene->mRootNode, idx);
+  mat4 meshTransform = meshNode ? to_mat4(global_transform(meshNode)) : mat4(1.f);
+  aiMatrix4x4 rootParentTransform = root->mParent ? global_transform(root->mParent) : aiMatrix4x4();
+
+  auto model = std::make_shared<AnimatedModel>();
+  model->skeleton = create_skeleton(root, mesh, rootParentTransform, meshTransform);
+  Skeleton &skeleton = *model->skeleton;
+
+  for (unsigned i = 0; i < scene->mNumAnimations; i++)
+    model->animations.push_back(create_animation(scene->mAnimations[i], skeleton, to_mat4(rootParentTransform)));
+
+  //every vertex moves with the bone of the largest weight
+  int numVert = mesh->mNumVertices;
+  std::vector<vec3> points(numVert);
+  std::vector<int> pointJoints(numVert, 0);
+  std::vector<float> pointWeights(numVert, 0.f);
+  std::vector<int> boneJoints(mesh->mNumBones);
+  for (int i = 0; i < numVert; i++)
+    points[i] = to_vec3(mesh->mVertices[i]);
+  for (unsigned i = 0; i < mesh->mNumBones; i++)
+  {
+    const aiBone *bone = mesh->mBones[i];
+    boneJoints[i] = glm::max(skeleton.find_joint(bone->mName.C_Str()), 0);
+    for (unsigned j = 0; j < bone->mNumWeights; j++)
+    {
+      const aiVertexWeight &weight = bone->mWeights[j];
+      if (weight.mWeight > pointWeights[weight.mVertexId])
+      {
+        pointWeights[weight.mVertexId] = weight.mWeight;
+        pointJoints[weight.mVertexId] = boneJoints[i];
+      }
+    }
+  }
+
+  std::vector<int> oldToNew = build_skeleton_lods(skeleton, model->animations, points, pointJoints, lod_settings);
+  for (int &joint : boneJoints)
+    joint = oldToNew[joint];
+
+  //bounds are computed in the root space
+  if (skeleton.find_joint(root_motion_settings.rootJoint) >= 0)
+    for (AnimationClipPtr &clip : model->animations)
+      extract_root_motion(skeleton, *clip, root_motion_settings);
+
+  model->jointBounds = compute_joint_bounds(mesh, skeleton, boneJoints);
+  for (AnimationClipPtr &clip : model->animations)
+    clip->bounds = compute_clip_bounds(*clip, skeleton, *model->jointBounds);
+  model->raycastModel = make_skinned_raycast_model(mesh, skeleton, boneJoints);
+
+  model->mesh = create_mesh(mesh, boneJoints);
+  debug_log("animated model %s: %d joints, %d animations", path, skeleton.joint_count(), (int)model->animations.size());
+  return model;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <render/mesh.h>
+#include "skeleton.h"
+#include "animation.h"
+#include "root_motion.h"
+#include "joint_bounds.h"
+#include "skinned_raycast.h"
+
+struct AnimatedModel
+{
+  MeshPtr mesh;
+  SkeletonPtr skeleton;
+  std::vector<AnimationClipPtr> animations;
+  JointBoundsPtr jointBounds;
+  SkinnedRaycastModelPtr raycastModel;
+};
+
+using AnimatedModelPtr = std::shared_ptr<AnimatedModel>;
+
+//imports mesh idx with its skeleton and all animations of the file, joints are sorted by skeleton lods,
+//root motion is extracted from the clips if the skeleton has the root motion joint
+AnimatedModelPtr load_animated_model(
+  const char *path,
+  int idx,
+  const SkeletonLodSettings &lod_settings = {},
+  const RootMotionSettings &root_motion_settings = {});
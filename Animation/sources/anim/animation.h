@@ -0,0 +1,31 @@
+#pragma once
+#include "3dmath.h"
+#include "bounds.h"
+#include <vector>
+#include <string>
+#include <memory>
+
+//keys are resampled with constant rate and stored frame by frame in skeleton joint order
+struct AnimationClip
+{
+  std::string name;
+  float duration;
+  float sampleRate;
+  int frameCount;
+  int jointCount;
+  std::vector<vec3> translations;
+  std::vector<quat> rotations;
+  std::vector<vec3> scales;
+  //skinned mesh bounds in model space over all frames
+  BoundingBox bounds;
+  //frames are deltas against a reference pose, see make_additive_clip
+  bool additive = false;
+  //extracted root motion per frame: x, z and unwrapped yaw of the root, empty if the clip stays in place
+  std::vector<vec3> rootMotion;
+
+  const vec3 *frame_translations(int frame) const { return translations.data() + frame * jointCount; }
+  const quat *frame_rotations(int frame) const { return rotations.data() + frame * jointCount; }
+  const vec3 *frame_scales(int frame) const { return scales.data() + frame * jointCount; }
+};
+
+using AnimationClipPtr = std::shared_ptr<AnimationClip>;
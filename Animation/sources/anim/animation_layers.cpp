@@ -0,0 +1,105 @@
+#include "animation_layers.h"
+#include <log.h>
+
+BoneMaskPtr make_bone_mask(const Skeleton &skeleton, const std::vector<std::string> &roots)
+{
+  int n = skeleton.joint_count();
+  auto mask = std::make_shared<BoneMask>();
+  mask->bits.assign((n + 63) / 64, 0);
+  for (const std::string &root : roots)
+  {
+    int joint = skeleton.find_joint(root.c_str());
+    if (joint >= 0)
+      mask->set(joint);
+    else
+      debug_error("bone mask: skeleton doesn't have %s joint", root.c_str());
+  }
+  //parents go first, so one pass spreads bits down the subtrees
+  for (int i = 0; i < n; i++)
+    if (skeleton.parents[i] >= 0 && mask->test(skeleton.parents[i]))
+      mask->set(i);
+  return mask;
+}
+
+BoneMaskPtr invert_bone_mask(const Skeleton &skeleton, const BoneMask &mask)
+{
+  auto result = std::make_shared<BoneMask>();
+  result->bits.assign(mask.bits.size(), 0);
+  for (int i = 0, n = skeleton.joint_count(); i < n; i++)
+    if (!mask.test(i))
+      result->set(i);
+  return result;
+}
+
+int count_masked_joints(const BoneMask &mask, int joint_count)
+{
+  int count = 0;
+  for_each_masked_joint(mask, joint_count, [&](int) { count++; });
+  return count;
+}
+
+Pose sample_reference_pose(const AnimationClip &clip, float time)
+{
+  Pose pose;
+  pose.resize(clip.jointCount);
+  sample_animation(clip, time, clip.jointCount, pose);
+  return pose;
+}
+
+AnimationClipPtr make_additive_clip(const AnimationClip &clip, const Pose &reference)
+{
+  auto additive = std::make_shared<AnimationClip>(clip);
+  additive->name = clip.name + "_additive";
+  additive->additive = true;
+  //additive layers don't move the character
+  additive->rootMotion.clear();
+  int n = clip.jointCount;
+  for (int frame = 0; frame < clip.frameCount; frame++)
+    for (int i = 0; i < n; i++)
+    {
+      int key = frame * n + i;
+      additive->translations[key] = clip.translations[key] - reference.translations[i];
+      additive->rotations[key] = normalize(inverse(reference.rotations[i]) * clip.rotations[key]);
+      additive->scales[key] = clip.scales[key] / reference.scales[i];
+    }
+  return additive;
+}
+
+void blend_animation_masked(const AnimationClip &clip, float time, const BoneMask &mask, float weight, int joint_count, Pose &pose)
+{
+  int frame0, frame1;
+  float t = find_clip_frames(clip, time, frame0, frame1);
+  const vec3 *translations0 = clip.frame_translations(frame0);
+  const vec3 *translations1 = clip.frame_translations(frame1);
+  const quat *rotations0 = clip.frame_rotations(frame0);
+  const quat *rotations1 = clip.frame_rotations(frame1);
+  const vec3 *scales0 = clip.frame_scales(frame0);
+  const vec3 *scales1 = clip.frame_scales(frame1);
+
+  for_each_masked_joint(mask, joint_count, [&](int i)
+  {
+    pose.translations[i] = mix(pose.translations[i], mix(translations0[i], translations1[i], t), weight);
+    pose.rotations[i] = nlerp(pose.rotations[i], nlerp(rotations0[i], rotations1[i], t), weight);
+    pose.scales[i] = mix(pose.scales[i], mix(scales0[i], scales1[i], t), weight);
+  });
+}
+
+void add_animation_masked(const AnimationClip &additive, float time, const BoneMask &mask, float weight, int joint_count, Pose &pose)
+{
+  int frame0, frame1;
+  float t = find_clip_frames(additive, time, frame0, frame1);
+  const vec3 *translations0 = additive.frame_translations(frame0);
+  const vec3 *translations1 = additive.frame_translations(frame1);
+  const quat *rotations0 = additive.frame_rotations(frame0);
+  const quat *rotations1 = additive.frame_rotations(frame1);
+  const vec3 *scales0 = additive.frame_scales(frame0);
+  const vec3 *scales1 = additive.frame_scales(frame1);
+  const quat identity = quat(1.f, 0.f, 0.f, 0.f);
+
+  for_each_masked_joint(mask, joint_count, [&](int i)
+  {
+    pose.translations[i] += mix(translations0[i], translations1[i], t) * weight;
+    pose.rotations[i] = normalize(pose.rotations[i] * nlerp(identity, nlerp(rotations0[i], rotations1[i], t), weight));
+    pose.scales[i] *= mix(vec3(1.f), mix(scales0[i], scales1[i], t), weight);
+  });
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "pose.h"
+#include <cstdint>
+
+//one bit per joint in skeleton joint order
+struct BoneMask
+{
+  std::vector<uint64_t> bits;
+
+  bool test(int joint) const { return bits[joint >> 6] >> (joint & 63) & 1; }
+  void set(int joint) { bits[joint >> 6] |= uint64_t(1) << (joint & 63); }
+};
+
+using BoneMaskPtr = std::shared_ptr<BoneMask>;
+
+//subtrees of the root joints
+BoneMaskPtr make_bone_mask(const Skeleton &skeleton, const std::vector<std::string> &roots);
+
+//all joints which are not in the mask
+BoneMaskPtr invert_bone_mask(const Skeleton &skeleton, const BoneMask &mask);
+
+//calls body(joint) for every masked joint among the first joint_count
+template<typename Body>
+inline void for_each_masked_joint(const BoneMask &mask, int joint_count, Body &&body)
+{
+  int words = glm::min((joint_count + 63) / 64, (int)mask.bits.size());
+  for (int word = 0; word < words; word++)
+  {
+    uint64_t bits = mask.bits[word];
+    int tail = joint_count - word * 64;
+    if (tail < 64)
+      bits &= (uint64_t(1) << tail) - 1;
+    for (; bits; bits &= bits - 1)
+      body(word * 64 + __builtin_ctzll(bits));
+  }
+}
+
+int count_masked_joints(const BoneMask &mask, int joint_count);
+
+//deltas of every frame against the reference pose, translations are offsets,
+//rotations are applied in the joint space (pose * delta), scales are factors
+AnimationClipPtr make_additive_clip(const AnimationClip &clip, const Pose &reference);
+
+//reference pose from a frame of a clip, usually the first frame of the clip itself
+Pose sample_reference_pose(const AnimationClip &clip, float time);
+
+//samples only masked joints and blends them over the pose, joints outside the mask aren't touched
+void blend_animation_masked(const AnimationClip &clip, float time, const BoneMask &mask, float weight, int joint_count, Pose &pose);
+
+//samples only masked joints of the additive clip and adds them to the pose
+void add_animation_masked(const AnimationClip &additive, float time, const BoneMask &mask, float weight, int joint_count, Pose &pose);
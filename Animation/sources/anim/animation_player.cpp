@@ -0,0 +1,191 @@
+#include "animation_player.h"
+#include "root_motion.h"
+
+void init_animation_player(AnimationPlayer &player, const SkeletonPtr &skeleton)
+{
+  int n = skeleton->joint_count();
+  player.skeleton = skeleton;
+  player.pose.resize(n);
+  player.blendPose.resize(n);
+  player.modelPose.resize(n, mat4(1.f));
+  player.palette.resize(n, mat4(1.f));
+}
+
+static float wrap_time(const AnimationClip &clip, float time)
+{
+  return clip.duration > 0.f ? time - floor(time / clip.duration) * clip.duration : 0.f;
+}
+
+static void apply_player_layers(const AnimationPlayer &player, float time_offset, int joint_count, Pose &pose)
+{
+  for (const AnimationLayer &layer : player.layers)
+  {
+    if (layer.weight <= 0.f)
+      continue;
+    float time = wrap_time(*layer.clip, layer.time + time_offset);
+    if (layer.clip->additive)
+      add_animation_masked(*layer.clip, time, *layer.mask, layer.weight, joint_count, pose);
+    else
+      blend_animation_masked(*layer.clip, time, *layer.mask, layer.weight, joint_count, pose);
+  }
+}
+
+//the pose evaluate_animation_player shows (crossfade, layers and inertialization offsets),
+//time_offset moves all clocks back or forward
+static void sample_player_pose(const AnimationPlayer &player, float time_offset, int joint_count, Pose &pose, Pose &blend_pose)
+{
+  sample_animation(*player.clip, wrap_time(*player.clip, player.time + time_offset), joint_count, pose);
+  if (player.prevClip)
+  {
+    float weight = glm::clamp((player.blendTime + time_offset) / player.blendDuration, 0.f, 1.f);
+    sample_animation(*player.prevClip, wrap_time(*player.prevClip, player.prevTime + time_offset), joint_count, blend_pose);
+    blend_poses(blend_pose, pose, weight, joint_count, pose);
+  }
+  apply_player_layers(player, time_offset, joint_count, pose);
+  if (player.inertialization.active)
+    apply_inertialization(player.inertialization, player.inertialization.time + time_offset, joint_count, pose);
+}
+
+static void start_player_inertialization(AnimationPlayer &player, const AnimationClipPtr &clip, float blend_duration)
+{
+  int n = player.skeleton->joint_count();
+  int jointCount = player.skeleton->lodJointCount[player.lod];
+  float dt = 1.f / clip->sampleRate;
+
+  Pose source, prevSource, target;
+  source.resize(n);
+  prevSource.resize(n);
+  target.resize(n);
+  sample_player_pose(player, 0.f, jointCount, source, target);
+  sample_player_pose(player, -dt, jointCount, prevSource, target);
+  //layers keep playing over the new clip, so they are a part of the target too
+  sample_animation(*clip, 0.f, jointCount, target);
+  apply_player_layers(player, 0.f, jointCount, target);
+
+  start_inertialization(player.inertialization, source, prevSource, target, target, dt, blend_duration, jointCount);
+}
+
+void play_animation(AnimationPlayer &player, const AnimationClipPtr &clip, float blend_duration, AnimationTransition transition)
+{
+  if (player.clip && blend_duration > 0.f)
+  {
+    if (transition == AnimationTransition::Inertialization)
+    {
+      start_player_inertialization(player, clip, blend_duration);
+      player.inertializationBounds = animation_bounds(player);
+      player.prevClip = nullptr;
+    }
+    else
+    {
+      player.prevClip = player.clip;
+      player.prevTime = player.time;
+      player.blendTime = 0.f;
+      player.blendDuration = blend_duration;
+      player.inertialization.active = false;
+    }
+  }
+  player.clip = clip;
+  player.time = 0.f;
+}
+
+int add_animation_layer(AnimationPlayer &player, const AnimationClipPtr &clip, const BoneMaskPtr &mask, float weight)
+{
+  player.layers.push_back(AnimationLayer{clip, mask, 0.f, weight});
+  return player.layers.size() - 1;
+}
+
+bool is_in_transition(const AnimationPlayer &player)
+{
+  return player.prevClip || player.inertialization.active;
+}
+
+static float advance_time(const AnimationClip &clip, float time, float dt)
+{
+  time += dt;
+  return clip.duration > 0.f ? fmod(time, clip.duration) : 0.f;
+}
+
+void advance_animation_player(AnimationPlayer &player, float dt)
+{
+  player.rootMotion = vec3(0.f);
+  if (!player.clip)
+    return;
+  float time = player.time;
+  player.time = advance_time(*player.clip, player.time, dt);
+  player.rootMotion = root_motion_delta(*player.clip, time, player.time);
+
+  if (player.prevClip)
+  {
+    player.blendTime += dt;
+    if (player.blendTime < player.blendDuration)
+    {
+      float prevTime = player.prevTime;
+      player.prevTime = advance_time(*player.prevClip, player.prevTime, dt);
+      //root motion is blended with the same weight as the poses
+      vec3 prevMotion = root_motion_delta(*player.prevClip, prevTime, player.prevTime);
+      player.rootMotion = mix(prevMotion, player.rootMotion, player.blendTime / player.blendDuration);
+    }
+    else
+      player.prevClip = nullptr;
+  }
+  advance_inertialization(player.inertialization, dt);
+
+  for (AnimationLayer &layer : player.layers)
+    layer.time = advance_time(*layer.clip, layer.time, dt);
+}
+
+void evaluate_animation_player(AnimationPlayer &player)
+{
+  float blendWeight = player.prevClip ? player.blendTime / player.blendDuration : 1.f;
+  evaluate_animation_player(player, player.time, player.prevTime, blendWeight);
+}
+
+void evaluate_animation_player(AnimationPlayer &player, float time, float prev_time, float blend_weight)
+{
+  player.sharedPose = nullptr;
+  if (!player.clip)
+    return;
+  const Skeleton &skeleton = *player.skeleton;
+  int jointCount = skeleton.lodJointCount[player.lod];
+
+  sample_animation(*player.clip, time, jointCount, player.pose);
+
+  if (player.prevClip)
+  {
+    sample_animation(*player.prevClip, prev_time, jointCount, player.blendPose);
+    blend_poses(player.blendPose, player.pose, blend_weight, jointCount, player.pose);
+  }
+  apply_player_layers(player, 0.f, jointCount, player.pose);
+  //offsets are applied to the layered pose, their source was sampled the same way
+  if (player.inertialization.active)
+    apply_inertialization(player.inertialization, player.inertialization.time, jointCount, player.pose);
+
+  local_to_model(skeleton, player.pose, jointCount, player.modelPose.data());
+  model_to_palette(skeleton, player.modelPose.data(), jointCount, player.palette.data());
+}
+
+void detach_shared_pose(AnimationPlayer &player)
+{
+  if (!player.sharedPose)
+    return;
+  player.pose = player.sharedPose->pose;
+  player.modelPose = player.sharedPose->modelPose;
+  player.palette = player.sharedPose->palette;
+  player.sharedPose = nullptr;
+}
+
+BoundingBox animation_bounds(const AnimationPlayer &player)
+{
+  BoundingBox bounds;
+  if (player.clip)
+    bounds.add(player.clip->bounds);
+  if (player.prevClip)
+    bounds.add(player.prevClip->bounds);
+  if (player.inertialization.active)
+    bounds.add(player.inertializationBounds);
+  //additive clips keep the bounds of their source clips
+  for (const AnimationLayer &layer : player.layers)
+    if (layer.weight > 0.f)
+      bounds.add(layer.clip->bounds);
+  return bounds;
+}
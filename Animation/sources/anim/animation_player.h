@@ -0,0 +1,91 @@
+#pragma once
+#include "pose.h"
+#include "inertialization.h"
+#include "animation_layers.h"
+
+enum class AnimationTransition
+{
+  Crossfade,
+  Inertialization
+};
+
+//clip played over the base pose on the masked joints, additive clips are added, others are blended
+struct AnimationLayer
+{
+  AnimationClipPtr clip;
+  BoneMaskPtr mask;
+  float time = 0.f;
+  //zero weight layers aren't sampled
+  float weight = 1.f;
+};
+
+//result of the evaluation which can be shared by players in identical state, see pose_cache.h
+struct SharedPose
+{
+  Pose pose;
+  std::vector<mat4> modelPose;
+  std::vector<mat4> palette;
+};
+
+struct AnimationPlayer
+{
+  SkeletonPtr skeleton;
+  AnimationClipPtr clip;
+  float time = 0.f;
+
+  //crossfade from the previous clip
+  AnimationClipPtr prevClip;
+  float prevTime = 0.f;
+  float blendTime = 0.f;
+  float blendDuration = 0.f;
+
+  //only the current clip is sampled, offsets from the previous pose decay over time
+  Inertialization inertialization;
+  BoundingBox inertializationBounds;
+
+  std::vector<AnimationLayer> layers;
+
+  //root displacement (x, z, yaw) of the last advance in the root space, see root_motion.h
+  vec3 rootMotion = vec3(0.f);
+
+  int lod = 0;
+  Pose pose;
+  Pose blendPose;
+  std::vector<mat4> modelPose;
+  std::vector<mat4> palette;
+  //set instead of own pose, model pose and palette when the pose cache had this state
+  const SharedPose *sharedPose = nullptr;
+};
+
+void init_animation_player(AnimationPlayer &player, const SkeletonPtr &skeleton);
+
+void play_animation(
+  AnimationPlayer &player,
+  const AnimationClipPtr &clip,
+  float blend_duration = 0.f,
+  AnimationTransition transition = AnimationTransition::Inertialization);
+
+//returns the layer index, layers are applied in the order of addition
+int add_animation_layer(AnimationPlayer &player, const AnimationClipPtr &clip, const BoneMaskPtr &mask, float weight = 1.f);
+
+bool is_in_transition(const AnimationPlayer &player);
+
+//moves clocks and extracts root motion, for characters which pose isn't needed this frame
+void advance_animation_player(AnimationPlayer &player, float dt);
+
+//sampling, blending, hierarchy and palette passes for the joints of player.lod
+void evaluate_animation_player(AnimationPlayer &player);
+
+//the same passes with explicit clip times and crossfade weight
+void evaluate_animation_player(AnimationPlayer &player, float time, float prev_time, float blend_weight);
+
+//copies the shared pose into own buffers, before per character changes like ik
+void detach_shared_pose(AnimationPlayer &player);
+
+inline const std::vector<mat4> &animation_palette(const AnimationPlayer &player)
+{
+  return player.sharedPose ? player.sharedPose->palette : player.palette;
+}
+
+//conservative model space bounds of the playing clips
+BoundingBox animation_bounds(const AnimationPlayer &player);
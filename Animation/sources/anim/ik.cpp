@@ -0,0 +1,239 @@
+#include "ik.h"
+#include "vec3x4.h"
+#include <algorithm>
+#include <log.h>
+
+IkChain make_ik_chain(const Skeleton &skeleton, const char *root, const char *tip)
+{
+  IkChain chain;
+  int rootJoint = skeleton.find_joint(root);
+  int joint = skeleton.find_joint(tip);
+  for (; joint >= 0 && joint != rootJoint; joint = skeleton.parents[joint])
+    chain.joints.push_back(joint);
+  if (rootJoint < 0 || joint != rootJoint || (int)chain.joints.size() >= MaxIkChainLength)
+  {
+    debug_error("ik: can't make chain from %s to %s", root, tip);
+    return IkChain();
+  }
+  chain.joints.push_back(rootJoint);
+  std::reverse(chain.joints.begin(), chain.joints.end());
+  return chain;
+}
+
+void IkBatch::resize(int chain_length, int count)
+{
+  chainLength = chain_length;
+  size = count;
+  capacity = (count + IkLanes - 1) / IkLanes * IkLanes;
+  //padding lanes stay zero, solvers guard every division so they can't produce nans
+  positions.assign(chain_length * 3 * capacity, 0.f);
+  targets.assign(3 * capacity, 0.f);
+  poles.assign(3 * capacity, 0.f);
+  lengths.assign(glm::max(chain_length - 1, 0) * capacity, 0.f);
+}
+
+void IkBatch::set_chain(int character, const vec3 *chain_positions, const vec3 &target, const vec3 &pole)
+{
+  for (int joint = 0; joint < chainLength; joint++)
+    for (int axis = 0; axis < 3; axis++)
+      positions[(joint * 3 + axis) * capacity + character] = chain_positions[joint][axis];
+  for (int joint = 0; joint + 1 < chainLength; joint++)
+    lengths[joint * capacity + character] = length(chain_positions[joint + 1] - chain_positions[joint]);
+  for (int axis = 0; axis < 3; axis++)
+  {
+    targets[axis * capacity + character] = target[axis];
+    poles[axis * capacity + character] = pole[axis];
+  }
+}
+
+void IkBatch::get_chain(int character, vec3 *chain_positions) const
+{
+  for (int joint = 0; joint < chainLength; joint++)
+    for (int axis = 0; axis < 3; axis++)
+      chain_positions[joint][axis] = positions[(joint * 3 + axis) * capacity + character];
+}
+
+static const float IkEpsilon = 1e-6f;
+
+static bool all_reached(const Vec3x4 &tip, const Vec3x4 &target, float tolerance)
+{
+  Vec3x4 d = sub(target, tip);
+  return _mm_movemask_ps(_mm_cmple_ps(dot(d, d), _mm_set1_ps(tolerance * tolerance))) == 0xF;
+}
+
+void solve_two_bone_ik(IkBatch &batch)
+{
+  if (batch.chainLength != 3)
+  {
+    debug_error("ik: two bone solver needs 3 joints, chain has %d", batch.chainLength);
+    return;
+  }
+  int capacity = batch.capacity;
+  const __m128 epsilon = _mm_set1_ps(IkEpsilon);
+  const __m128 one = _mm_set1_ps(1.f);
+  for (int lane = 0; lane < capacity; lane += IkLanes)
+  {
+    Vec3x4 a = load(&batch.positions[0], capacity, lane);
+    Vec3x4 target = load(batch.targets.data(), capacity, lane);
+    Vec3x4 pole = load(batch.poles.data(), capacity, lane);
+    __m128 upper = _mm_loadu_ps(&batch.lengths[lane]);
+    __m128 lower = _mm_loadu_ps(&batch.lengths[capacity + lane]);
+
+    //unreachable targets straighten the chain, too close ones fold it
+    Vec3x4 toTarget = sub(target, a);
+    Vec3x4 direction = normalize(toTarget);
+    __m128 minReach = _mm_add_ps(_mm_max_ps(_mm_sub_ps(upper, lower), _mm_sub_ps(lower, upper)), epsilon);
+    __m128 maxReach = _mm_sub_ps(_mm_add_ps(upper, lower), epsilon);
+    __m128 reach = _mm_min_ps(_mm_max_ps(length(toTarget), minReach), maxReach);
+
+    //law of cosines for the angle between the upper bone and the root to target line
+    __m128 cosAngle = _mm_div_ps(
+      _mm_sub_ps(_mm_add_ps(_mm_mul_ps(upper, upper), _mm_mul_ps(reach, reach)), _mm_mul_ps(lower, lower)),
+      _mm_max_ps(_mm_mul_ps(_mm_add_ps(upper, upper), reach), epsilon));
+    cosAngle = _mm_min_ps(_mm_max_ps(cosAngle, _mm_set1_ps(-1.f)), one);
+    __m128 sinAngle = _mm_sqrt_ps(_mm_sub_ps(one, _mm_mul_ps(cosAngle, cosAngle)));
+
+    Vec3x4 toPole = sub(pole, a);
+    Vec3x4 bend = normalize(sub(toPole, mul(direction, dot(toPole, direction))));
+
+    Vec3x4 mid = add(a, add(mul(direction, _mm_mul_ps(upper, cosAngle)), mul(bend, _mm_mul_ps(upper, sinAngle))));
+    Vec3x4 tip = add(a, mul(direction, reach));
+    store(mid, &batch.positions[3 * capacity], capacity, lane);
+    store(tip, &batch.positions[6 * capacity], capacity, lane);
+  }
+}
+
+//rotates v by unit quaternion (u, w)
+static Vec3x4 rotate(const Vec3x4 &u, __m128 w, const Vec3x4 &v)
+{
+  Vec3x4 t = cross(u, v);
+  t = add(t, t);
+  return add(v, add(mul(t, w), cross(u, t)));
+}
+
+void solve_ccd_ik(IkBatch &batch, int iterations, float tolerance)
+{
+  int n = batch.chainLength;
+  int capacity = batch.capacity;
+  const __m128 epsilon = _mm_set1_ps(IkEpsilon);
+  Vec3x4 p[MaxIkChainLength];
+  for (int lane = 0; lane < capacity; lane += IkLanes)
+  {
+    for (int i = 0; i < n; i++)
+      p[i] = load(&batch.positions[i * 3 * capacity], capacity, lane);
+    Vec3x4 target = load(batch.targets.data(), capacity, lane);
+
+    for (int iteration = 0; iteration < iterations && !all_reached(p[n - 1], target, tolerance); iteration++)
+      for (int j = n - 2; j >= 0; j--)
+      {
+        Vec3x4 from = sub(p[n - 1], p[j]);
+        Vec3x4 to = sub(target, p[j]);
+        //shortest arc between from and to, identity for degenerate lanes
+        Vec3x4 u = cross(from, to);
+        __m128 w = _mm_add_ps(_mm_sqrt_ps(_mm_mul_ps(dot(from, from), dot(to, to))), dot(from, to));
+        __m128 norm = _mm_sqrt_ps(_mm_add_ps(dot(u, u), _mm_mul_ps(w, w)));
+        __m128 valid = _mm_cmpgt_ps(norm, epsilon);
+        __m128 invNorm = _mm_div_ps(_mm_set1_ps(1.f), _mm_max_ps(norm, epsilon));
+        u = mul(u, _mm_and_ps(valid, invNorm));
+        w = select(valid, _mm_mul_ps(w, invNorm), _mm_set1_ps(1.f));
+        for (int k = j + 1; k < n; k++)
+          p[k] = add(p[j], rotate(u, w, sub(p[k], p[j])));
+      }
+
+    for (int i = 1; i < n; i++)
+      store(p[i], &batch.positions[i * 3 * capacity], capacity, lane);
+  }
+}
+
+void solve_fabrik_ik(IkBatch &batch, int iterations, float tolerance)
+{
+  int n = batch.chainLength;
+  int capacity = batch.capacity;
+  Vec3x4 p[MaxIkChainLength];
+  __m128 lengths[MaxIkChainLength];
+  for (int lane = 0; lane < capacity; lane += IkLanes)
+  {
+    for (int i = 0; i < n; i++)
+      p[i] = load(&batch.positions[i * 3 * capacity], capacity, lane);
+    for (int i = 0; i + 1 < n; i++)
+      lengths[i] = _mm_loadu_ps(&batch.lengths[i * capacity + lane]);
+    Vec3x4 target = load(batch.targets.data(), capacity, lane);
+    Vec3x4 root = p[0];
+
+    for (int iteration = 0; iteration < iterations && !all_reached(p[n - 1], target, tolerance); iteration++)
+    {
+      p[n - 1] = target;
+      for (int i = n - 2; i >= 0; i--)
+        p[i] = add(p[i + 1], mul(normalize(sub(p[i], p[i + 1])), lengths[i]));
+      p[0] = root;
+      for (int i = 1; i < n; i++)
+        p[i] = add(p[i - 1], mul(normalize(sub(p[i], p[i - 1])), lengths[i - 1]));
+    }
+
+    for (int i = 1; i < n; i++)
+      store(p[i], &batch.positions[i * 3 * capacity], capacity, lane);
+  }
+}
+
+static quat shortest_arc(const vec3 &from, const vec3 &to)
+{
+  float w = 1.f + dot(from, to);
+  if (w < IkEpsilon)
+    return quat(1.f, 0.f, 0.f, 0.f);
+  vec3 axis = cross(from, to);
+  return normalize(quat(w, axis.x, axis.y, axis.z));
+}
+
+static quat model_rotation(const mat4 &m)
+{
+  return quat_cast(mat3(normalize(vec3(m[0])), normalize(vec3(m[1])), normalize(vec3(m[2]))));
+}
+
+static mat4 joint_transform(const Skeleton &skeleton, const Pose &pose, const mat4 *model, int joint)
+{
+  int parent = skeleton.parents[joint];
+  mat4 local = compose_transform(pose.translations[joint], pose.rotations[joint], pose.scales[joint]);
+  return parent >= 0 ? model[parent] * local : local;
+}
+
+void apply_ik_chain(const Skeleton &skeleton, const IkChain &chain, const vec3 *positions, int joint_count, Pose &pose, mat4 *model)
+{
+  const std::vector<int> &joints = chain.joints;
+  int n = joints.size();
+  if (n < 2 || joints.back() >= joint_count)
+    return;
+
+  for (int i = 0; i + 1 < n; i++)
+  {
+    int joint = joints[i];
+    int child = joints[i + 1];
+    //both still follow the old transform of the joint rotated at the previous step
+    model[joint] = joint_transform(skeleton, pose, model, joint);
+    model[child] = joint_transform(skeleton, pose, model, child);
+    vec3 position = vec3(model[joint][3]);
+    vec3 from = vec3(model[child][3]) - position;
+    vec3 to = positions[i + 1] - position;
+    if (dot(from, from) < IkEpsilon * IkEpsilon || dot(to, to) < IkEpsilon * IkEpsilon)
+      continue;
+
+    //model space rotation moved into the local space of the joint
+    quat delta = shortest_arc(normalize(from), normalize(to));
+    int parent = skeleton.parents[joint];
+    quat parentRotation = parent >= 0 ? model_rotation(model[parent]) : quat(1.f, 0.f, 0.f, 0.f);
+    pose.rotations[joint] = normalize(inverse(parentRotation) * delta * parentRotation * pose.rotations[joint]);
+    model[joint] = joint_transform(skeleton, pose, model, joint);
+  }
+
+  //joints are parent first, so a joint is a descendant of the chain root when its parent is
+  static thread_local std::vector<char> dirty;
+  dirty.assign(joint_count, 0);
+  dirty[joints[0]] = 1;
+  for (int i = joints[0] + 1; i < joint_count; i++)
+  {
+    int parent = skeleton.parents[i];
+    if (parent < 0 || !dirty[parent])
+      continue;
+    dirty[i] = 1;
+    model[i] = joint_transform(skeleton, pose, model, i);
+  }
+}
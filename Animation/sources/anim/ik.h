@@ -0,0 +1,49 @@
+#pragma once
+#include "pose.h"
+
+constexpr int MaxIkChainLength = 16;
+//characters solved together in simd registers
+constexpr int IkLanes = 4;
+
+//joints from the chain root to the end effector, every joint is the parent of the next one
+struct IkChain
+{
+  std::vector<int> joints;
+};
+
+//empty chain if tip isn't a descendant of root
+IkChain make_ik_chain(const Skeleton &skeleton, const char *root, const char *tip);
+
+//the same chain of many characters, model space positions are stored by coordinates so
+//every simd register holds IkLanes characters
+struct IkBatch
+{
+  int chainLength = 0;
+  int size = 0;
+  //size padded to IkLanes
+  int capacity = 0;
+  //x, y, z rows of capacity floats for every chain joint
+  std::vector<float> positions;
+  std::vector<float> targets;
+  //two bone solver bends the middle joint towards the pole
+  std::vector<float> poles;
+  //chainLength - 1 rows of bone lengths, taken from the positions in set_chain
+  std::vector<float> lengths;
+
+  void resize(int chain_length, int count);
+  void set_chain(int character, const vec3 *chain_positions, const vec3 &target, const vec3 &pole);
+  void get_chain(int character, vec3 *chain_positions) const;
+};
+
+//analytic solver for three joint chains (upper leg, leg, foot)
+void solve_two_bone_ik(IkBatch &batch);
+
+//cyclic coordinate descent, rotates the chain tail around every joint from the tip to the root
+void solve_ccd_ik(IkBatch &batch, int iterations, float tolerance);
+
+//forward and backward reaching, keeps bone lengths and the chain root
+void solve_fabrik_ik(IkBatch &batch, int iterations, float tolerance);
+
+//rotates chain joints of the pose to pass through solved positions and recomputes model transforms
+//of the joints after the chain root, chain must be inside joint_count
+void apply_ik_chain(const Skeleton &skeleton, const IkChain &chain, const vec3 *positions, int joint_count, Pose &pose, mat4 *model);
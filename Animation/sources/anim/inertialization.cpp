@@ -0,0 +1,110 @@
+#include "inertialization.h"
+
+static InertializedChannel make_channel(const vec3 &axis, float x0, float prev_x, float dt, float duration)
+{
+  InertializedChannel channel;
+  channel.axis = axis;
+  channel.x0 = x0;
+  //offset can't grow, and it mustn't overshoot zero
+  channel.v0 = glm::min((x0 - prev_x) / dt, 0.f);
+  if (channel.v0 < 0.f)
+    duration = glm::min(duration, -5.f * x0 / channel.v0);
+  channel.duration = duration;
+
+  float t1 = glm::max(duration, 1e-4f);
+  float t2 = t1 * t1;
+  float x = x0, v = channel.v0;
+  float a0 = (-8.f * v * t1 - 20.f * x) / t2;
+  channel.a = -(a0 * t2 + 6.f * v * t1 + 12.f * x) / (2.f * t2 * t2 * t1);
+  channel.b = (3.f * a0 * t2 + 16.f * v * t1 + 30.f * x) / (2.f * t2 * t2);
+  channel.c = -(3.f * a0 * t2 + 12.f * v * t1 + 20.f * x) / (2.f * t2 * t1);
+  channel.d = a0 * 0.5f;
+  return channel;
+}
+
+static float evaluate_channel(const InertializedChannel &channel, float t)
+{
+  if (t >= channel.duration)
+    return 0.f;
+  return ((((channel.a * t + channel.b) * t + channel.c) * t + channel.d) * t + channel.v0) * t + channel.x0;
+}
+
+static quat rotation_offset(const quat &from, const quat &to)
+{
+  quat offset = from * inverse(to);
+  return offset.w < 0.f ? -offset : offset;
+}
+
+void start_inertialization(
+  Inertialization &inertialization,
+  const Pose &source, const Pose &prev_source,
+  const Pose &target, const Pose &prev_target,
+  float dt, float duration, int joint_count)
+{
+  int n = source.translations.size();
+  inertialization.translations.assign(n, InertializedChannel{vec3(0.f), 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f});
+  inertialization.rotations.assign(n, InertializedChannel{vec3(0.f), 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f});
+  inertialization.time = 0.f;
+  inertialization.duration = duration;
+  inertialization.active = true;
+
+  for (int i = 0; i < joint_count; i++)
+  {
+    vec3 offset = source.translations[i] - target.translations[i];
+    float x0 = length(offset);
+    if (x0 > 1e-6f)
+    {
+      vec3 axis = offset / x0;
+      float prevX = dot(prev_source.translations[i] - prev_target.translations[i], axis);
+      inertialization.translations[i] = make_channel(axis, x0, prevX, dt, duration);
+    }
+
+    quat rotation = rotation_offset(source.rotations[i], target.rotations[i]);
+    vec3 sinAxis = vec3(rotation.x, rotation.y, rotation.z);
+    float sinHalfAngle = length(sinAxis);
+    if (sinHalfAngle > 1e-6f)
+    {
+      vec3 axis = sinAxis / sinHalfAngle;
+      float angle = 2.f * atan2(sinHalfAngle, rotation.w);
+      quat prevRotation = rotation_offset(prev_source.rotations[i], prev_target.rotations[i]);
+      float prevAngle = 2.f * atan2(dot(vec3(prevRotation.x, prevRotation.y, prevRotation.z), axis), prevRotation.w);
+      inertialization.rotations[i] = make_channel(axis, angle, prevAngle, dt, duration);
+    }
+  }
+}
+
+void advance_inertialization(Inertialization &inertialization, float dt)
+{
+  if (!inertialization.active)
+    return;
+  inertialization.time += dt;
+  inertialization.active = inertialization.time < inertialization.duration;
+}
+
+void apply_inertialization(const Inertialization &inertialization, float time, int joint_count, Pose &pose)
+{
+  float t = glm::max(time, 0.f);
+  for (int i = 0; i < joint_count; i++)
+  {
+    const InertializedChannel &translation = inertialization.translations[i];
+    pose.translations[i] += translation.axis * evaluate_channel(translation, t);
+  }
+  for (int i = 0; i < joint_count; i++)
+  {
+    const InertializedChannel &rotation = inertialization.rotations[i];
+    float angle = evaluate_channel(rotation, t);
+    if (angle != 0.f)
+      pose.rotations[i] = angleAxis(angle, rotation.axis) * pose.rotations[i];
+  }
+}
+
+void apply_joint_inertialization(const Inertialization &inertialization, float time, int joint, vec3 &translation, quat &rotation)
+{
+  float t = glm::max(time, 0.f);
+  const InertializedChannel &translationChannel = inertialization.translations[joint];
+  translation += translationChannel.axis * evaluate_channel(translationChannel, t);
+  const InertializedChannel &rotationChannel = inertialization.rotations[joint];
+  float angle = evaluate_channel(rotationChannel, t);
+  if (angle != 0.f)
+    rotation = angleAxis(angle, rotationChannel.axis) * rotation;
+}
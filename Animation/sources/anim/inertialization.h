@@ -0,0 +1,35 @@
+#pragma once
+#include "pose.h"
+
+//offset along axis which decays to zero with the quintic polynomial from "Inertialization: High-Performance Animation Transitions"
+struct InertializedChannel
+{
+  vec3 axis;
+  float duration;
+  float x0, v0;
+  float a, b, c, d;
+};
+
+struct Inertialization
+{
+  std::vector<InertializedChannel> translations;
+  std::vector<InertializedChannel> rotations;
+  float time = 0.f;
+  float duration = 0.f;
+  bool active = false;
+};
+
+//offsets between the outgoing pose and the incoming pose, previous poses (dt ago) give offset velocities
+void start_inertialization(
+  Inertialization &inertialization,
+  const Pose &source, const Pose &prev_source,
+  const Pose &target, const Pose &prev_target,
+  float dt, float duration, int joint_count);
+
+void advance_inertialization(Inertialization &inertialization, float dt);
+
+//adds offsets decayed to the time to the pose of the incoming clip
+void apply_inertialization(const Inertialization &inertialization, float time, int joint_count, Pose &pose);
+
+//the same offsets for one joint
+void apply_joint_inertialization(const Inertialization &inertialization, float time, int joint, vec3 &translation, quat &rotation);
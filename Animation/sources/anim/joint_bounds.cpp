@@ -0,0 +1,90 @@
+#include "joint_bounds.h"
+#include <assimp/scene.h>
+
+//occluder boxes are scaled by this around the center
+static const float OccluderScale = 0.5f;
+//smallest side of an occluder box relative to the largest side of the mesh
+static const float OccluderMinSize = 0.05f;
+//vertices with smaller weights are left out of occluders
+static const float OccluderMinWeight = 0.5f;
+
+JointBoundsPtr compute_joint_bounds(const aiMesh *mesh, const Skeleton &skeleton, const std::vector<int> &bone_joints)
+{
+  int n = skeleton.joint_count();
+  std::vector<std::vector<vec3>> points(n);
+  std::vector<BoundingBox> occluderBoxes(n);
+  BoundingBox meshBox;
+  for (unsigned i = 0; i < mesh->mNumVertices; i++)
+    meshBox.add(to_vec3(mesh->mVertices[i]));
+  for (unsigned i = 0; i < mesh->mNumBones; i++)
+  {
+    const aiBone *bone = mesh->mBones[i];
+    const mat4 &toJoint = skeleton.inverseBindPose[bone_joints[i]];
+    for (unsigned j = 0; j < bone->mNumWeights; j++)
+      if (bone->mWeights[j].mWeight > 0.f)
+      {
+        vec3 p = vec3(toJoint * vec4(to_vec3(mesh->mVertices[bone->mWeights[j].mVertexId]), 1.f));
+        points[bone_joints[i]].push_back(p);
+        if (bone->mWeights[j].mWeight >= OccluderMinWeight)
+          occluderBoxes[bone_joints[i]].add(p);
+      }
+  }
+  vec3 meshSize = meshBox.empty() ? vec3(0.f) : meshBox.max - meshBox.min;
+  float minOccluderSize = OccluderMinSize * glm::max(meshSize.x, glm::max(meshSize.y, meshSize.z));
+
+  auto bounds = std::make_shared<JointBounds>();
+  for (int i = 0; i < n; i++)
+  {
+    if (points[i].empty())
+      continue;
+    BoundingBox box;
+    for (const vec3 &p : points[i])
+      box.add(p);
+    vec3 center = (box.min + box.max) * 0.5f;
+    float radius = 0.f;
+    for (const vec3 &p : points[i])
+      radius = glm::max(radius, length(p - center));
+    bounds->joints.push_back(i);
+    bounds->bindPose.push_back(inverse(skeleton.inverseBindPose[i]));
+    bounds->spheres.push_back(vec4(center, radius));
+    bounds->boxes.push_back(box);
+
+    BoundingBox occluder = occluderBoxes[i];
+    if (occluder.empty())
+      continue;
+    vec3 occluderCenter = (occluder.min + occluder.max) * 0.5f;
+    vec3 extent = (occluder.max - occluder.min) * (0.5f * OccluderScale);
+    if (2.f * glm::min(extent.x, glm::min(extent.y, extent.z)) < minOccluderSize)
+      continue;
+    bounds->occluders.push_back(bounds->joints.size() - 1);
+    bounds->occluderBoxes.push_back(BoundingBox{occluderCenter - extent, occluderCenter + extent});
+  }
+  return bounds;
+}
+
+BoundingBox skinned_bounds(const JointBounds &bounds, const mat4 &transform, const mat4 *palette)
+{
+  BoundingBox result;
+  for (int i = 0, n = bounds.joints.size(); i < n; i++)
+  {
+    mat4 m = transform * palette[bounds.joints[i]] * bounds.bindPose[i];
+    BoundingBox box = transform_bounds(m, bounds.boxes[i]);
+    const vec4 &sphere = bounds.spheres[i];
+    float scale = glm::max(length(vec3(m[0])), glm::max(length(vec3(m[1])), length(vec3(m[2]))));
+    vec3 center = vec3(m * vec4(vec3(sphere), 1.f));
+    //the box is loose for rotated joints, the sphere for long ones
+    box.min = glm::max(box.min, center - vec3(sphere.w * scale));
+    box.max = glm::min(box.max, center + vec3(sphere.w * scale));
+    result.add(box);
+  }
+  return result;
+}
+
+void add_skinned_occluders(OcclusionBuffer &buffer, const JointBounds &bounds, const mat4 &transform, const mat4 *palette)
+{
+  for (int i = 0, n = bounds.occluders.size(); i < n; i++)
+  {
+    int joint = bounds.occluders[i];
+    add_occluder(buffer, transform * palette[bounds.joints[joint]] * bounds.bindPose[joint], bounds.occluderBoxes[i]);
+  }
+}
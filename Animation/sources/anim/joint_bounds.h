@@ -0,0 +1,32 @@
+#pragma once
+#include "skeleton.h"
+#include "bounds.h"
+#include "occlusion_culling.h"
+
+struct aiMesh;
+
+//joint space bounds of the vertices influenced by every joint, only joints with vertices are stored
+struct JointBounds
+{
+  std::vector<int> joints;
+  //joint to mesh bind space, palette * bindPose is the model transform of the joint
+  std::vector<mat4> bindPose;
+  //center and radius
+  std::vector<vec4> spheres;
+  std::vector<BoundingBox> boxes;
+  //indices of thick joints in the arrays above and joint space boxes of their vertices with the largest
+  //weights scaled around the center, so they stay inside the mesh for occlusion culling
+  std::vector<int> occluders;
+  std::vector<BoundingBox> occluderBoxes;
+};
+
+using JointBoundsPtr = std::shared_ptr<JointBounds>;
+
+//bone_joints maps aiMesh bones to skeleton joints
+JointBoundsPtr compute_joint_bounds(const aiMesh *mesh, const Skeleton &skeleton, const std::vector<int> &bone_joints);
+
+//bounds of the skinned mesh in O(joints), every joint adds the intersection of its transformed box and sphere,
+//collapsed joints of skeleton lods follow the palette of their parents like the vertices do
+BoundingBox skinned_bounds(const JointBounds &bounds, const mat4 &transform, const mat4 *palette);
+
+void add_skinned_occluders(OcclusionBuffer &buffer, const JointBounds &bounds, const mat4 &transform, const mat4 *palette);
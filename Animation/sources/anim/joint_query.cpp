@@ -0,0 +1,78 @@
+#include "joint_query.h"
+
+//local transform of the joint, the same steps as evaluate_animation_player does for the whole pose
+static mat4 sample_player_joint(const AnimationPlayer &player, int joint)
+{
+  vec3 translation, scale;
+  quat rotation;
+  sample_joint(*player.clip, player.time, joint, translation, rotation, scale);
+
+  if (player.prevClip)
+  {
+    vec3 prevTranslation, prevScale;
+    quat prevRotation;
+    sample_joint(*player.prevClip, player.prevTime, joint, prevTranslation, prevRotation, prevScale);
+    float weight = player.blendTime / player.blendDuration;
+    translation = mix(prevTranslation, translation, weight);
+    rotation = nlerp(prevRotation, rotation, weight);
+    scale = mix(prevScale, scale, weight);
+  }
+  if (player.inertialization.active)
+    apply_joint_inertialization(player.inertialization, player.inertialization.time, joint, translation, rotation);
+
+  const quat identity = quat(1.f, 0.f, 0.f, 0.f);
+  for (const AnimationLayer &layer : player.layers)
+  {
+    if (layer.weight <= 0.f || !layer.mask->test(joint))
+      continue;
+    vec3 layerTranslation, layerScale;
+    quat layerRotation;
+    sample_joint(*layer.clip, layer.time, joint, layerTranslation, layerRotation, layerScale);
+    if (layer.clip->additive)
+    {
+      translation += layerTranslation * layer.weight;
+      rotation = normalize(rotation * nlerp(identity, layerRotation, layer.weight));
+      scale *= mix(vec3(1.f), layerScale, layer.weight);
+    }
+    else
+    {
+      translation = mix(translation, layerTranslation, layer.weight);
+      rotation = nlerp(rotation, layerRotation, layer.weight);
+      scale = mix(scale, layerScale, layer.weight);
+    }
+  }
+  return compose_transform(translation, rotation, scale);
+}
+
+//recursion stops at the first joint already evaluated in this frame
+static const mat4 &evaluate_joint_chain(const AnimationPlayer &player, JointQueryCache &cache, int joint, int frame)
+{
+  if (cache.jointFrames[joint] == frame)
+    return cache.model[joint];
+  int parent = player.skeleton->parents[joint];
+  mat4 local = sample_player_joint(player, joint);
+  cache.model[joint] = parent >= 0 ? evaluate_joint_chain(player, cache, parent, frame) * local : local;
+  cache.jointFrames[joint] = frame;
+  cache.evaluatedJoints++;
+  return cache.model[joint];
+}
+
+const mat4 &query_joint_transform(const AnimationPlayer &player, JointQueryCache &cache, int joint, int frame)
+{
+  if (cache.frame != frame)
+  {
+    int n = player.skeleton->joint_count();
+    cache.frame = frame;
+    cache.model.resize(n);
+    cache.jointFrames.assign(n, -1);
+    cache.queries = 0;
+    cache.evaluatedJoints = 0;
+  }
+  cache.queries++;
+  if (!player.clip)
+  {
+    cache.model[joint] = mat4(1.f);
+    return cache.model[joint];
+  }
+  return evaluate_joint_chain(player, cache, joint, frame);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "animation_player.h"
+
+//model space transforms of single joints for players which pose isn't evaluated or has the joint
+//collapsed by the skeleton lod, joints of the frame are reused by the next queries in the same frame
+struct JointQueryCache
+{
+  int frame = -1;
+  std::vector<mat4> model;
+  std::vector<int> jointFrames;
+
+  int queries = 0;
+  //joints sampled and concatenated by the queries of this frame
+  int evaluatedJoints = 0;
+};
+
+//samples and concatenates only the chain from the root to the joint with all clips, transitions and layers
+//of the player, frame is any counter which changes when the player time does
+const mat4 &query_joint_transform(const AnimationPlayer &player, JointQueryCache &cache, int joint, int frame);
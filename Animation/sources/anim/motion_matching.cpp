@@ -0,0 +1,282 @@
+#include "motion_matching.h"
+#include "pose.h"
+#include "root_motion.h"
+#include <immintrin.h>
+#include <log.h>
+
+struct CharacterFrame
+{
+  vec3 position;
+  vec2 forward;
+
+  vec3 to_local_vector(const vec3 &v) const
+  {
+    return vec3(v.x * forward.y - v.z * forward.x, v.y, dot(vec2(v.x, v.z), forward));
+  }
+  vec3 to_local_point(const vec3 &p) const { return to_local_vector(p - position); }
+};
+
+static CharacterFrame character_frame(const mat4 &hips)
+{
+  vec2 forward = vec2(hips[2].x, hips[2].z);
+  float len = length(forward);
+  return CharacterFrame{vec3(hips[3].x, 0.f, hips[3].z), len > 1e-6f ? forward / len : vec2(0.f, 1.f)};
+}
+
+static void pack_features(const MotionQuery &query, float *raw)
+{
+  const vec3 vectors[] = {query.leftFootPosition, query.rightFootPosition,
+    query.leftFootVelocity, query.rightFootVelocity, query.hipsVelocity};
+  int k = 0;
+  for (const vec3 &v : vectors)
+    for (int i = 0; i < 3; i++)
+      raw[k++] = v[i];
+  for (const vec2 &p : query.trajectoryPositions)
+    for (int i = 0; i < 2; i++)
+      raw[k++] = p[i];
+  for (const vec2 &d : query.trajectoryDirections)
+    for (int i = 0; i < 2; i++)
+      raw[k++] = d[i];
+  for (; k < MotionFeatureStride; k++)
+    raw[k] = 0.f;
+}
+
+struct FeatureGroup
+{
+  int begin, end;
+  float weight;
+};
+
+static void normalize_features(MotionDatabase &database, const MotionMatchingSettings &settings)
+{
+  const FeatureGroup groups[] = {
+    {0, 6, settings.feetPositionWeight},
+    {6, 12, settings.feetVelocityWeight},
+    {12, 15, settings.hipsVelocityWeight},
+    {15, 21, settings.trajectoryPositionWeight},
+    {21, 27, settings.trajectoryDirectionWeight}};
+
+  int rows = database.rowCount;
+  std::vector<float> &features = database.features;
+  for (int i = 0; i < MotionFeatureCount; i++)
+  {
+    double sum = 0.0;
+    for (int row = 0; row < rows; row++)
+      sum += features[row * MotionFeatureStride + i];
+    database.mean[i] = float(sum / glm::max(rows, 1));
+  }
+
+  //the whole group shares one deviation, so directions and positions keep their shape
+  for (const FeatureGroup &group : groups)
+  {
+    double variance = 0.0;
+    for (int row = 0; row < rows; row++)
+      for (int i = group.begin; i < group.end; i++)
+      {
+        double d = features[row * MotionFeatureStride + i] - database.mean[i];
+        variance += d * d;
+      }
+    variance /= glm::max(rows * (group.end - group.begin), 1);
+    float deviation = glm::max(float(sqrt(variance)), 1e-5f);
+    for (int i = group.begin; i < group.end; i++)
+      database.scale[i] = group.weight / deviation;
+  }
+
+  for (int row = 0; row < rows; row++)
+    for (int i = 0; i < MotionFeatureCount; i++)
+    {
+      float &f = features[row * MotionFeatureStride + i];
+      f = (f - database.mean[i]) * database.scale[i];
+    }
+}
+
+static void build_boxes(const MotionDatabase &database, int box_size, std::vector<float> &box_min, std::vector<float> &box_max)
+{
+  int boxCount = (database.rowCount + box_size - 1) / box_size;
+  box_min.assign(boxCount * MotionFeatureStride, FLT_MAX);
+  box_max.assign(boxCount * MotionFeatureStride, -FLT_MAX);
+  for (int row = 0; row < database.rowCount; row++)
+  {
+    const float *f = &database.features[row * MotionFeatureStride];
+    float *bmin = &box_min[(row / box_size) * MotionFeatureStride];
+    float *bmax = &box_max[(row / box_size) * MotionFeatureStride];
+    for (int i = 0; i < MotionFeatureStride; i++)
+    {
+      bmin[i] = glm::min(bmin[i], f[i]);
+      bmax[i] = glm::max(bmax[i], f[i]);
+    }
+  }
+}
+
+MotionDatabasePtr build_motion_database(
+  const Skeleton &skeleton,
+  const std::vector<AnimationClipPtr> &clips,
+  const MotionMatchingSettings &settings)
+{
+  int hips = skeleton.find_joint(settings.hipsJoint);
+  int leftFoot = skeleton.find_joint(settings.leftFootJoint);
+  int rightFoot = skeleton.find_joint(settings.rightFootJoint);
+  if (hips < 0 || leftFoot < 0 || rightFoot < 0)
+  {
+    debug_error("motion matching: skeleton doesn't have %s, %s or %s joint",
+      settings.hipsJoint, settings.leftFootJoint, settings.rightFootJoint);
+    return nullptr;
+  }
+  int jointCount = glm::max(glm::max(hips, leftFoot), rightFoot) + 1;
+
+  auto database = std::make_shared<MotionDatabase>();
+  database->clips = clips;
+  Pose pose;
+  pose.resize(skeleton.joint_count());
+  std::vector<mat4> model(jointCount);
+
+  for (int clipIdx = 0; clipIdx < (int)clips.size(); clipIdx++)
+  {
+    const AnimationClip &clip = *clips[clipIdx];
+    int frames = clip.frameCount;
+    std::vector<mat4> hipsPose(frames), leftFootPose(frames), rightFootPose(frames);
+    for (int frame = 0; frame < frames; frame++)
+    {
+      sample_animation(clip, frame / clip.sampleRate, jointCount, pose);
+      local_to_model(skeleton, pose, jointCount, model.data());
+      //features need the motion in clip space, not in the root space
+      mat4 root = root_motion_transform(sample_root_motion(clip, frame / clip.sampleRate));
+      hipsPose[frame] = root * model[hips];
+      leftFootPose[frame] = root * model[leftFoot];
+      rightFootPose[frame] = root * model[rightFoot];
+    }
+
+    for (int frame = 0; frame < frames; frame++)
+    {
+      int next = glm::min(frame + 1, frames - 1);
+      int prev = glm::max(next - 1, 0);
+      float velocityScale = next > prev ? clip.sampleRate : 0.f;
+      auto velocity = [&](const std::vector<mat4> &poses)
+      {
+        return (vec3(poses[next][3]) - vec3(poses[prev][3])) * velocityScale;
+      };
+
+      CharacterFrame root = character_frame(hipsPose[frame]);
+      MotionQuery query;
+      query.leftFootPosition = root.to_local_point(vec3(leftFootPose[frame][3]));
+      query.rightFootPosition = root.to_local_point(vec3(rightFootPose[frame][3]));
+      query.leftFootVelocity = root.to_local_vector(velocity(leftFootPose));
+      query.rightFootVelocity = root.to_local_vector(velocity(rightFootPose));
+      query.hipsVelocity = root.to_local_vector(velocity(hipsPose));
+      for (int i = 0; i < MotionTrajectoryPoints; i++)
+      {
+        CharacterFrame future = character_frame(hipsPose[glm::min(frame + settings.trajectoryFrames[i], frames - 1)]);
+        vec3 position = root.to_local_point(future.position);
+        vec3 direction = root.to_local_vector(vec3(future.forward.x, 0.f, future.forward.y));
+        query.trajectoryPositions[i] = vec2(position.x, position.z);
+        query.trajectoryDirections[i] = vec2(direction.x, direction.z);
+      }
+
+      database->features.resize((database->rowCount + 1) * MotionFeatureStride);
+      pack_features(query, &database->features[database->rowCount * MotionFeatureStride]);
+      database->rowClips.push_back(clipIdx);
+      database->rowFrames.push_back(frame);
+      database->rowCount++;
+    }
+  }
+
+  normalize_features(*database, settings);
+  build_boxes(*database, MotionSmallBoxSize, database->smallBoxMin, database->smallBoxMax);
+  build_boxes(*database, MotionLargeBoxSize, database->largeBoxMin, database->largeBoxMax);
+  debug_log("motion database: %d frames, %d features", database->rowCount, MotionFeatureCount);
+  return database;
+}
+
+void make_motion_query(const MotionDatabase &database, const MotionQuery &query, float *features)
+{
+  pack_features(query, features);
+  for (int i = 0; i < MotionFeatureCount; i++)
+    features[i] = (features[i] - database.mean[i]) * database.scale[i];
+}
+
+static float box_distance(const float *box_min, const float *box_max, const float *query)
+{
+  float cost = 0.f;
+  for (int i = 0; i < MotionFeatureCount; i++)
+  {
+    float d = query[i] - glm::clamp(query[i], box_min[i], box_max[i]);
+    cost += d * d;
+  }
+  return cost;
+}
+
+static MotionMatch make_match(const MotionDatabase &database, int row, float cost)
+{
+  return MotionMatch{database.rowClips[row], database.rowFrames[row], cost};
+}
+
+MotionMatch search_motion_database(const MotionDatabase &database, const float *query)
+{
+  int bestRow = -1;
+  float bestCost = FLT_MAX;
+  int largeBoxCount = database.largeBoxMin.size() / MotionFeatureStride;
+  for (int large = 0; large < largeBoxCount; large++)
+  {
+    int offset = large * MotionFeatureStride;
+    if (box_distance(&database.largeBoxMin[offset], &database.largeBoxMax[offset], query) >= bestCost)
+      continue;
+
+    int smallBegin = large * (MotionLargeBoxSize / MotionSmallBoxSize);
+    int smallEnd = glm::min(smallBegin + MotionLargeBoxSize / MotionSmallBoxSize, int(database.smallBoxMin.size() / MotionFeatureStride));
+    for (int small = smallBegin; small < smallEnd; small++)
+    {
+      offset = small * MotionFeatureStride;
+      if (box_distance(&database.smallBoxMin[offset], &database.smallBoxMax[offset], query) >= bestCost)
+        continue;
+
+      int rowEnd = glm::min((small + 1) * MotionSmallBoxSize, database.rowCount);
+      for (int row = small * MotionSmallBoxSize; row < rowEnd; row++)
+      {
+        const float *f = &database.features[row * MotionFeatureStride];
+        float cost = 0.f;
+        for (int i = 0; i < MotionFeatureCount && cost < bestCost; i++)
+        {
+          float d = query[i] - f[i];
+          cost += d * d;
+        }
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestRow = row;
+        }
+      }
+    }
+  }
+  return bestRow >= 0 ? make_match(database, bestRow, bestCost) : MotionMatch();
+}
+
+MotionMatch search_motion_database_brute_force(const MotionDatabase &database, const float *query)
+{
+  static_assert(MotionFeatureStride % 4 == 0);
+  constexpr int Lanes = MotionFeatureStride / 4;
+  __m128 q[Lanes];
+  for (int i = 0; i < Lanes; i++)
+    q[i] = _mm_loadu_ps(query + i * 4);
+
+  int bestRow = -1;
+  float bestCost = FLT_MAX;
+  const float *f = database.features.data();
+  for (int row = 0; row < database.rowCount; row++, f += MotionFeatureStride)
+  {
+    __m128 sum = _mm_setzero_ps();
+    for (int i = 0; i < Lanes; i++)
+    {
+      __m128 d = _mm_sub_ps(q[i], _mm_loadu_ps(f + i * 4));
+      sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    float cost = _mm_cvtss_f32(sum);
+    if (cost < bestCost)
+    {
+      bestCost = cost;
+      bestRow = row;
+    }
+  }
+  return bestRow >= 0 ? make_match(database, bestRow, bestCost) : MotionMatch();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "skeleton.h"
+#include "animation.h"
+
+constexpr int MotionTrajectoryPoints = 3;
+constexpr int MotionFeatureCount = 27;
+//rows are padded for simd
+constexpr int MotionFeatureStride = 28;
+constexpr int MotionSmallBoxSize = 16;
+constexpr int MotionLargeBoxSize = 64;
+
+struct MotionMatchingSettings
+{
+  const char *hipsJoint = "Hips";
+  const char *leftFootJoint = "LeftFoot";
+  const char *rightFootJoint = "RightFoot";
+  //future trajectory samples in clip frames
+  int trajectoryFrames[MotionTrajectoryPoints] = {10, 20, 30};
+  float feetPositionWeight = 0.75f;
+  float feetVelocityWeight = 1.f;
+  float hipsVelocityWeight = 1.f;
+  float trajectoryPositionWeight = 1.f;
+  float trajectoryDirectionWeight = 1.5f;
+};
+
+//everything is in the character frame: hips projected on the ground, facing along the hips z axis
+struct MotionQuery
+{
+  vec3 leftFootPosition, rightFootPosition;
+  vec3 leftFootVelocity, rightFootVelocity;
+  vec3 hipsVelocity;
+  vec2 trajectoryPositions[MotionTrajectoryPoints];
+  vec2 trajectoryDirections[MotionTrajectoryPoints];
+};
+
+struct MotionDatabase
+{
+  std::vector<AnimationClipPtr> clips;
+  std::vector<int> rowClips;
+  std::vector<int> rowFrames;
+  int rowCount = 0;
+
+  //rowCount x MotionFeatureStride, normalized = (raw - mean) * scale
+  std::vector<float> features;
+  float mean[MotionFeatureStride] = {};
+  float scale[MotionFeatureStride] = {};
+
+  //bounding boxes of consecutive rows
+  std::vector<float> smallBoxMin, smallBoxMax;
+  std::vector<float> largeBoxMin, largeBoxMax;
+};
+
+using MotionDatabasePtr = std::shared_ptr<MotionDatabase>;
+
+struct MotionMatch
+{
+  int clip = -1;
+  int frame = -1;
+  float cost = FLT_MAX;
+};
+
+//extracts features of every clip frame into a normalized contiguous matrix
+MotionDatabasePtr build_motion_database(
+  const Skeleton &skeleton,
+  const std::vector<AnimationClipPtr> &clips,
+  const MotionMatchingSettings &settings = {});
+
+//normalized feature vector of MotionFeatureStride floats
+void make_motion_query(const MotionDatabase &database, const MotionQuery &query, float *features);
+
+//bounding box hierarchy search
+MotionMatch search_motion_database(const MotionDatabase &database, const float *query);
+
+MotionMatch search_motion_database_brute_force(const MotionDatabase &database, const float *query);
@@ -0,0 +1,86 @@
+#include "pose.h"
+
+mat4 compose_transform(const vec3 &translation, const quat &rotation, const vec3 &scale)
+{
+  mat3 r = mat3_cast(rotation);
+  return mat4(
+    vec4(r[0] * scale.x, 0.f),
+    vec4(r[1] * scale.y, 0.f),
+    vec4(r[2] * scale.z, 0.f),
+    vec4(translation, 1.f));
+}
+
+quat nlerp(const quat &a, const quat &b, float t)
+{
+  float sign = dot(a, b) < 0.f ? -1.f : 1.f;
+  quat q = a * (1.f - t) + b * (t * sign);
+  return q * inversesqrt(dot(q, q));
+}
+
+float find_clip_frames(const AnimationClip &clip, float time, int &frame0, int &frame1)
+{
+  float frame = glm::clamp(time * clip.sampleRate, 0.f, float(clip.frameCount - 1));
+  frame0 = int(frame);
+  frame1 = glm::min(frame0 + 1, clip.frameCount - 1);
+  return frame - frame0;
+}
+
+void sample_animation(const AnimationClip &clip, float time, int joint_count, Pose &pose)
+{
+  int frame0, frame1;
+  float t = find_clip_frames(clip, time, frame0, frame1);
+
+  const vec3 *translations0 = clip.frame_translations(frame0);
+  const vec3 *translations1 = clip.frame_translations(frame1);
+  const quat *rotations0 = clip.frame_rotations(frame0);
+  const quat *rotations1 = clip.frame_rotations(frame1);
+  const vec3 *scales0 = clip.frame_scales(frame0);
+  const vec3 *scales1 = clip.frame_scales(frame1);
+
+  for (int i = 0; i < joint_count; i++)
+    pose.translations[i] = mix(translations0[i], translations1[i], t);
+  for (int i = 0; i < joint_count; i++)
+    pose.rotations[i] = nlerp(rotations0[i], rotations1[i], t);
+  for (int i = 0; i < joint_count; i++)
+    pose.scales[i] = mix(scales0[i], scales1[i], t);
+}
+
+void sample_joint(const AnimationClip &clip, float time, int joint, vec3 &translation, quat &rotation, vec3 &scale)
+{
+  int frame0, frame1;
+  float t = find_clip_frames(clip, time, frame0, frame1);
+  translation = mix(clip.frame_translations(frame0)[joint], clip.frame_translations(frame1)[joint], t);
+  rotation = nlerp(clip.frame_rotations(frame0)[joint], clip.frame_rotations(frame1)[joint], t);
+  scale = mix(clip.frame_scales(frame0)[joint], clip.frame_scales(frame1)[joint], t);
+}
+
+void blend_poses(const Pose &from, const Pose &to, float weight, int joint_count, Pose &result)
+{
+  for (int i = 0; i < joint_count; i++)
+    result.translations[i] = mix(from.translations[i], to.translations[i], weight);
+  for (int i = 0; i < joint_count; i++)
+    result.rotations[i] = nlerp(from.rotations[i], to.rotations[i], weight);
+  for (int i = 0; i < joint_count; i++)
+    result.scales[i] = mix(from.scales[i], to.scales[i], weight);
+}
+
+void local_to_model(const Skeleton &skeleton, const Pose &pose, int joint_count, mat4 *model)
+{
+  const int *parents = skeleton.parents.data();
+  for (int i = 0; i < joint_count; i++)
+  {
+    mat4 local = compose_transform(pose.translations[i], pose.rotations[i], pose.scales[i]);
+    model[i] = parents[i] >= 0 ? model[parents[i]] * local : local;
+  }
+}
+
+void model_to_palette(const Skeleton &skeleton, const mat4 *model, int joint_count, mat4 *palette)
+{
+  const mat4 *inverseBindPose = skeleton.inverseBindPose.data();
+  for (int i = 0; i < joint_count; i++)
+    palette[i] = model[i] * inverseBindPose[i];
+
+  const int *parents = skeleton.parents.data();
+  for (int i = joint_count, n = skeleton.joint_count(); i < n; i++)
+    palette[i] = palette[parents[i]];
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "skeleton.h"
+#include "animation.h"
+
+//local joint transforms, structure of arrays in skeleton joint order
+struct Pose
+{
+  std::vector<vec3> translations;
+  std::vector<quat> rotations;
+  std::vector<vec3> scales;
+
+  void resize(int joint_count)
+  {
+    translations.resize(joint_count);
+    rotations.resize(joint_count);
+    scales.resize(joint_count);
+  }
+};
+
+//frames around the time, returns the interpolation factor between them
+float find_clip_frames(const AnimationClip &clip, float time, int &frame0, int &frame1);
+
+//all passes process only first joint_count joints (active skeleton lod)
+void sample_animation(const AnimationClip &clip, float time, int joint_count, Pose &pose);
+
+//one joint of sample_animation
+void sample_joint(const AnimationClip &clip, float time, int joint, vec3 &translation, quat &rotation, vec3 &scale);
+
+void blend_poses(const Pose &from, const Pose &to, float weight, int joint_count, Pose &result);
+
+void local_to_model(const Skeleton &skeleton, const Pose &pose, int joint_count, mat4 *model);
+
+//joints behind joint_count are collapsed into their parents and reuse their skinning matrix
+void model_to_palette(const Skeleton &skeleton, const mat4 *model, int joint_count, mat4 *palette);
+
+mat4 compose_transform(const vec3 &translation, const quat &rotation, const vec3 &scale);
+
+quat nlerp(const quat &a, const quat &b, float t);
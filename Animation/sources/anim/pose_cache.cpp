@@ -0,0 +1,86 @@
+#include "pose_cache.h"
+
+size_t PoseCacheKeyHash::operator()(const PoseCacheKey &key) const
+{
+  size_t hash = std::hash<const void *>()(key.clip);
+  auto combine = [&](size_t value) { hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+  combine(std::hash<const void *>()(key.prevClip));
+  combine(key.step);
+  combine(key.prevStep);
+  combine(key.blendStep);
+  combine(key.lod);
+  return hash;
+}
+
+void begin_pose_cache_frame(PoseCache &cache)
+{
+  cache.entries.clear();
+  cache.poolIndex ^= 1;
+  cache.usedEntries = 0;
+  cache.lookups = 0;
+  cache.hits = 0;
+  cache.bypasses = 0;
+}
+
+static bool is_cacheable(const AnimationPlayer &player)
+{
+  if (player.inertialization.active)
+    return false;
+  for (const AnimationLayer &layer : player.layers)
+    if (layer.weight > 0.f)
+      return false;
+  return true;
+}
+
+static SharedPose *allocate_entry(PoseCache &cache)
+{
+  std::vector<std::unique_ptr<SharedPose>> &pool = cache.pools[cache.poolIndex];
+  if (cache.usedEntries == (int)pool.size())
+    pool.emplace_back(std::make_unique<SharedPose>());
+  return pool[cache.usedEntries++].get();
+}
+
+bool evaluate_cached_animation_player(PoseCache &cache, AnimationPlayer &player)
+{
+  if (!player.clip || !is_cacheable(player))
+  {
+    cache.bypasses++;
+    evaluate_animation_player(player);
+    return false;
+  }
+
+  float step = glm::max(cache.timeQuantization, 1e-4f);
+  float weightStep = glm::max(cache.weightQuantization, 1e-4f);
+  PoseCacheKey key{player.clip.get(), player.prevClip.get(), int(player.time / step + 0.5f), 0, 0, player.lod};
+  if (player.prevClip)
+  {
+    key.prevStep = int(player.prevTime / step + 0.5f);
+    key.blendStep = int(player.blendTime / player.blendDuration / weightStep + 0.5f);
+  }
+
+  SharedPose *entry;
+  bool hit;
+  cache.lookups++;
+  {
+    std::unique_lock lock(cache.mutex);
+    auto [it, inserted] = cache.entries.try_emplace(key, nullptr);
+    if (inserted)
+      it->second = allocate_entry(cache);
+    entry = it->second;
+    hit = !inserted;
+  }
+  if (hit)
+  {
+    //the entry is filled by its first player before the poses are used after the animation jobs
+    cache.hits++;
+    player.sharedPose = entry;
+    return true;
+  }
+
+  evaluate_animation_player(player, key.step * step, key.prevStep * step, glm::min(key.blendStep * weightStep, 1.f));
+  entry->pose = player.pose;
+  entry->modelPose = player.modelPose;
+  entry->palette = player.palette;
+  player.sharedPose = entry;
+  return false;
+}
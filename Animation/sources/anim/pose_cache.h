@@ -0,0 +1,51 @@
+#pragma once
+#include "animation_player.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+struct PoseCacheKey
+{
+  const AnimationClip *clip;
+  const AnimationClip *prevClip;
+  int step;
+  int prevStep;
+  int blendStep;
+  int lod;
+
+  bool operator==(const PoseCacheKey &other) const
+  {
+    return clip == other.clip && prevClip == other.prevClip && step == other.step &&
+      prevStep == other.prevStep && blendStep == other.blendStep && lod == other.lod;
+  }
+};
+
+struct PoseCacheKeyHash
+{
+  size_t operator()(const PoseCacheKey &key) const;
+};
+
+//players in the same state share one evaluation per frame, times are snapped to the quantization,
+//players with inertialization or layers have unique poses and aren't cached
+struct PoseCache
+{
+  float timeQuantization = 1.f / 30.f;
+  float weightQuantization = 1.f / 16.f;
+
+  std::mutex mutex;
+  std::unordered_map<PoseCacheKey, SharedPose *, PoseCacheKeyHash> entries;
+  //entries of the previous frame stay valid for one more frame, so culled players can detach from them
+  std::vector<std::unique_ptr<SharedPose>> pools[2];
+  int poolIndex = 0;
+  int usedEntries = 0;
+
+  std::atomic<int> lookups{0};
+  std::atomic<int> hits{0};
+  //players which can't be cached
+  std::atomic<int> bypasses{0};
+};
+
+void begin_pose_cache_frame(PoseCache &cache);
+
+//evaluates the player or points it to the shared pose of the same state, returns true on a cache hit
+bool evaluate_cached_animation_player(PoseCache &cache, AnimationPlayer &player);
@@ -0,0 +1,158 @@
+#include "retargeting.h"
+#include <algorithm>
+#include <cctype>
+#include <log.h>
+
+//"mixamorig:LeftArm" and "leftarm" match
+static std::string canonical_joint_name(const std::string &name)
+{
+  size_t colon = name.find_last_of(':');
+  std::string result = colon == std::string::npos ? name : name.substr(colon + 1);
+  std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return std::tolower(c); });
+  return result;
+}
+
+static int find_canonical_joint(const Skeleton &skeleton, const std::string &name)
+{
+  std::string canonical = canonical_joint_name(name);
+  for (int i = 0, n = skeleton.joint_count(); i < n; i++)
+    if (canonical_joint_name(skeleton.names[i]) == canonical)
+      return i;
+  return -1;
+}
+
+static void bind_model_pose(const Skeleton &skeleton, std::vector<quat> &rotations, std::vector<vec3> &positions)
+{
+  int n = skeleton.joint_count();
+  std::vector<mat4> model(n);
+  rotations.resize(n);
+  positions.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    int parent = skeleton.parents[i];
+    mat4 local = compose_transform(skeleton.bindTranslations[i], skeleton.bindRotations[i], skeleton.bindScales[i]);
+    model[i] = parent >= 0 ? model[parent] * local : local;
+    rotations[i] = normalize(quat_cast(mat3(normalize(vec3(model[i][0])), normalize(vec3(model[i][1])), normalize(vec3(model[i][2])))));
+    positions[i] = vec3(model[i][3]);
+  }
+}
+
+RetargetMapPtr make_retarget_map(const Skeleton &source, const Skeleton &target, const RetargetSettings &settings)
+{
+  int n = target.joint_count();
+  std::vector<int> targetToSource(n, -1);
+  for (int i = 0; i < n; i++)
+    targetToSource[i] = find_canonical_joint(source, target.names[i]);
+  for (const auto &[sourceName, targetName] : settings.jointNames)
+  {
+    int sourceJoint = source.find_joint(sourceName.c_str());
+    int targetJoint = target.find_joint(targetName.c_str());
+    if (sourceJoint < 0 || targetJoint < 0)
+    {
+      debug_error("retargeting: can't map %s to %s", sourceName.c_str(), targetName.c_str());
+      continue;
+    }
+    targetToSource[targetJoint] = sourceJoint;
+  }
+
+  std::vector<quat> sourceRotations, targetRotations;
+  std::vector<vec3> sourcePositions, targetPositions;
+  bind_model_pose(source, sourceRotations, sourcePositions);
+  bind_model_pose(target, targetRotations, targetPositions);
+
+  auto map = std::make_shared<RetargetMap>();
+  map->sourceJointCount = source.joint_count();
+  map->targetJointCount = n;
+  int sourceRoot = source.find_joint(settings.rootJoint);
+  int targetRoot = target.find_joint(settings.rootJoint);
+  if (sourceRoot >= 0 && targetRoot >= 0 && glm::abs(sourcePositions[sourceRoot].y) > 1e-6f)
+    map->rootScale = targetPositions[targetRoot].y / sourcePositions[sourceRoot].y;
+
+  const quat identity = quat(1.f, 0.f, 0.f, 0.f);
+  for (int i = 0; i < n; i++)
+  {
+    int s = targetToSource[i];
+    if (s < 0)
+    {
+      map->unmappedJoints.push_back(i);
+      continue;
+    }
+    //the same model space rotation from the bind pose for both skeletons
+    quat sourceParent = source.parents[s] >= 0 ? sourceRotations[source.parents[s]] : identity;
+    quat targetParent = target.parents[i] >= 0 ? targetRotations[target.parents[i]] : identity;
+    float sourceLength = length(source.bindTranslations[s]);
+    float scale = i == targetRoot ? map->rootScale :
+      sourceLength > 1e-6f ? length(target.bindTranslations[i]) / sourceLength : 1.f;
+
+    map->targetJoints.push_back(i);
+    map->sourceJoints.push_back(s);
+    map->preRotations.push_back(normalize(inverse(targetParent) * sourceParent));
+    map->postRotations.push_back(normalize(inverse(sourceRotations[s]) * targetRotations[i]));
+    map->translationScales.push_back(scale);
+    map->sourceBindTranslations.push_back(source.bindTranslations[s]);
+    map->targetBindTranslations.push_back(target.bindTranslations[i]);
+    map->scaleFactors.push_back(target.bindScales[i] / source.bindScales[s]);
+  }
+  debug_log("retargeting: %d of %d joints mapped", (int)map->targetJoints.size(), n);
+  return map;
+}
+
+void retarget_pose(const RetargetMap &map, const Skeleton &target, const Pose &source, int joint_count, Pose &result)
+{
+  for (int joint : map.unmappedJoints)
+  {
+    if (joint >= joint_count)
+      break;
+    result.translations[joint] = target.bindTranslations[joint];
+    result.rotations[joint] = target.bindRotations[joint];
+    result.scales[joint] = target.bindScales[joint];
+  }
+
+  const int *targetJoints = map.targetJoints.data();
+  const int *sourceJoints = map.sourceJoints.data();
+  int n = std::lower_bound(map.targetJoints.begin(), map.targetJoints.end(), joint_count) - map.targetJoints.begin();
+  for (int i = 0; i < n; i++)
+  {
+    int s = sourceJoints[i];
+    result.rotations[targetJoints[i]] = map.preRotations[i] * source.rotations[s] * map.postRotations[i];
+  }
+  for (int i = 0; i < n; i++)
+  {
+    vec3 offset = map.preRotations[i] * (source.translations[sourceJoints[i]] - map.sourceBindTranslations[i]);
+    result.translations[targetJoints[i]] = map.targetBindTranslations[i] + offset * map.translationScales[i];
+  }
+  for (int i = 0; i < n; i++)
+    result.scales[targetJoints[i]] = source.scales[sourceJoints[i]] * map.scaleFactors[i];
+}
+
+AnimationClipPtr retarget_clip(const RetargetMap &map, const Skeleton &target, const AnimationClip &clip)
+{
+  int n = map.targetJointCount;
+  auto result = std::make_shared<AnimationClip>(clip);
+  result->jointCount = n;
+  result->translations.resize(clip.frameCount * n);
+  result->rotations.resize(clip.frameCount * n);
+  result->scales.resize(clip.frameCount * n);
+
+  Pose source, pose;
+  source.resize(clip.jointCount);
+  pose.resize(n);
+  for (int frame = 0; frame < clip.frameCount; frame++)
+  {
+    int key = frame * clip.jointCount;
+    std::copy_n(clip.translations.begin() + key, clip.jointCount, source.translations.begin());
+    std::copy_n(clip.rotations.begin() + key, clip.jointCount, source.rotations.begin());
+    std::copy_n(clip.scales.begin() + key, clip.jointCount, source.scales.begin());
+    retarget_pose(map, target, source, n, pose);
+    std::copy(pose.translations.begin(), pose.translations.end(), result->translations.begin() + frame * n);
+    std::copy(pose.rotations.begin(), pose.rotations.end(), result->rotations.begin() + frame * n);
+    std::copy(pose.scales.begin(), pose.scales.end(), result->scales.begin() + frame * n);
+  }
+
+  for (vec3 &motion : result->rootMotion)
+    motion = vec3(vec2(motion) * map.rootScale, motion.z);
+  //approximation, exact bounds need joint spheres of the target mesh
+  result->bounds.min *= map.rootScale;
+  result->bounds.max *= map.rootScale;
+  return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "pose.h"
+#include <string>
+#include <utility>
+
+struct RetargetSettings
+{
+  //source joint name -> target joint name, other joints are matched by name without namespace prefix
+  std::vector<std::pair<std::string, std::string>> jointNames;
+  //its translation is scaled by the ratio of the bind heights, other joints keep target proportions
+  const char *rootJoint = "Hips";
+};
+
+//flat tables in target joint order built once per skeleton pair
+struct RetargetMap
+{
+  int sourceJointCount = 0;
+  int targetJointCount = 0;
+  //mapped joints sorted by target joint
+  std::vector<int> targetJoints;
+  std::vector<int> sourceJoints;
+  //target local rotation = pre * source local rotation * post
+  std::vector<quat> preRotations;
+  std::vector<quat> postRotations;
+  //target translation = target bind + scale * pre * (source translation - source bind)
+  std::vector<float> translationScales;
+  std::vector<vec3> sourceBindTranslations;
+  std::vector<vec3> targetBindTranslations;
+  std::vector<vec3> scaleFactors;
+  //joints without source keep the target bind pose
+  std::vector<int> unmappedJoints;
+  float rootScale = 1.f;
+};
+
+using RetargetMapPtr = std::shared_ptr<RetargetMap>;
+
+RetargetMapPtr make_retarget_map(const Skeleton &source, const Skeleton &target, const RetargetSettings &settings = {});
+
+//source pose must contain all source joints, the first joint_count target joints are written
+void retarget_pose(const RetargetMap &map, const Skeleton &target, const Pose &source, int joint_count, Pose &result);
+
+//cook time retargeting of every frame, root motion is scaled with the root
+AnimationClipPtr retarget_clip(const RetargetMap &map, const Skeleton &target, const AnimationClip &clip);
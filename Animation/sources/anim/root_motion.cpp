@@ -0,0 +1,92 @@
+#include "root_motion.h"
+#include "pose.h"
+#include <log.h>
+
+static vec2 rotate_yaw(const vec2 &v, float yaw)
+{
+  float c = cos(yaw), s = sin(yaw);
+  return vec2(v.x * c + v.y * s, -v.x * s + v.y * c);
+}
+
+mat4 root_motion_transform(const vec3 &motion)
+{
+  mat4 transform = mat4_cast(angleAxis(motion.z, vec3(0.f, 1.f, 0.f)));
+  transform[3] = vec4(motion.x, 0.f, motion.y, 1.f);
+  return transform;
+}
+
+bool extract_root_motion(const Skeleton &skeleton, AnimationClip &clip, const RootMotionSettings &settings)
+{
+  int root = skeleton.find_joint(settings.rootJoint);
+  if (root < 0)
+  {
+    debug_error("root motion: skeleton doesn't have %s joint", settings.rootJoint);
+    return false;
+  }
+  int parent = skeleton.parents[root];
+  int jointCount = root + 1;
+  Pose pose;
+  pose.resize(skeleton.joint_count());
+  std::vector<mat4> model(jointCount);
+
+  clip.rootMotion.resize(clip.frameCount);
+  float prevYaw = 0.f;
+  for (int frame = 0; frame < clip.frameCount; frame++)
+  {
+    sample_animation(clip, frame / clip.sampleRate, jointCount, pose);
+    local_to_model(skeleton, pose, jointCount, model.data());
+    const mat4 &rootTransform = model[root];
+
+    float yaw = prevYaw;
+    vec2 forward = vec2(rootTransform[2].x, rootTransform[2].z);
+    if (settings.extractYaw && length(forward) > 1e-6f)
+    {
+      //unwrapped, so frames can be interpolated
+      yaw = atan2(forward.x, forward.y);
+      yaw -= round((yaw - prevYaw) / PITWO) * PITWO;
+    }
+    prevYaw = yaw;
+    vec3 &motion = clip.rootMotion[frame];
+    motion = vec3(rootTransform[3].x, rootTransform[3].z, yaw);
+
+    //root keeps its height and tilt, parent space is recovered from the model transforms
+    mat4 local = inverse(root_motion_transform(motion)) * rootTransform;
+    if (parent >= 0)
+      local = inverse(model[parent]) * local;
+    clip.translations[frame * clip.jointCount + root] = vec3(local[3]);
+    clip.rotations[frame * clip.jointCount + root] = normalize(quat_cast(mat3(
+      normalize(vec3(local[0])), normalize(vec3(local[1])), normalize(vec3(local[2])))));
+  }
+  return true;
+}
+
+vec3 sample_root_motion(const AnimationClip &clip, float time)
+{
+  if (clip.rootMotion.empty())
+    return vec3(0.f);
+  float frame = glm::clamp(time * clip.sampleRate, 0.f, float(clip.frameCount - 1));
+  int frame0 = int(frame);
+  int frame1 = glm::min(frame0 + 1, clip.frameCount - 1);
+  return mix(clip.rootMotion[frame0], clip.rootMotion[frame1], frame - frame0);
+}
+
+vec3 combine_root_motion(const vec3 &a, const vec3 &b)
+{
+  return vec3(vec2(a) + rotate_yaw(vec2(b), a.z), a.z + b.z);
+}
+
+static vec3 root_motion_difference(const vec3 &from, const vec3 &to)
+{
+  return vec3(rotate_yaw(vec2(to) - vec2(from), -from.z), to.z - from.z);
+}
+
+vec3 root_motion_delta(const AnimationClip &clip, float from, float to)
+{
+  if (clip.rootMotion.empty())
+    return vec3(0.f);
+  vec3 start = sample_root_motion(clip, from);
+  if (to >= from)
+    return root_motion_difference(start, sample_root_motion(clip, to));
+  vec3 toEnd = root_motion_difference(start, clip.rootMotion.back());
+  return combine_root_motion(toEnd, root_motion_difference(clip.rootMotion.front(), sample_root_motion(clip, to)));
+}
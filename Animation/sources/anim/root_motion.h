@@ -0,0 +1,25 @@
+#pragma once
+#include "skeleton.h"
+#include "animation.h"
+
+struct RootMotionSettings
+{
+  const char *rootJoint = "Hips";
+  //false keeps the facing in the pose and extracts only the horizontal translation
+  bool extractYaw = true;
+};
+
+//moves horizontal translation and yaw of the root joint from the clip frames into clip.rootMotion,
+//so the pose stays above the origin facing +z
+bool extract_root_motion(const Skeleton &skeleton, AnimationClip &clip, const RootMotionSettings &settings = {});
+
+//x, z and yaw in clip space
+vec3 sample_root_motion(const AnimationClip &clip, float time);
+
+//displacement from time `from` to time `to` in the root space at `from`, looped clips wrap when to < from
+vec3 root_motion_delta(const AnimationClip &clip, float from, float to);
+
+//displacement a followed by displacement b
+vec3 combine_root_motion(const vec3 &a, const vec3 &b);
+
+mat4 root_motion_transform(const vec3 &motion);
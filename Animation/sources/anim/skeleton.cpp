@@ -0,0 +1,140 @@
+#include "skeleton.h"
+#include <algorithm>
+#include <cfloat>
+#include <log.h>
+
+int Skeleton::find_joint(const char *name) const
+{
+  for (int i = 0, n = joint_count(); i < n; i++)
+    if (names[i] == name)
+      return i;
+  return -1;
+}
+
+int select_skeleton_lod(const Skeleton &skeleton, float distance, float tolerance)
+{
+  int lod = 0;
+  for (int i = 1; i < skeleton.lodCount; i++)
+    if (skeleton.lodError[i] <= tolerance * distance)
+      lod = i;
+  return lod;
+}
+
+template<typename T>
+static void permute(std::vector<T> &values, const std::vector<int> &order, int stride)
+{
+  std::vector<T> result(values.size());
+  int n = order.size();
+  for (size_t offset = 0; offset < values.size(); offset += stride)
+    for (int i = 0; i < n; i++)
+      result[offset + i] = values[offset + order[i]];
+  values = std::move(result);
+}
+
+std::vector<int> build_skeleton_lods(
+  Skeleton &skeleton,
+  std::vector<AnimationClipPtr> &clips,
+  const std::vector<vec3> &points,
+  const std::vector<int> &point_joints,
+  const SkeletonLodSettings &settings)
+{
+  const int n = skeleton.joint_count();
+  const std::vector<int> &parents = skeleton.parents;
+
+  std::vector<vec3> jointPositions(n);
+  for (int i = 0; i < n; i++)
+    jointPositions[i] = vec3(inverse(skeleton.inverseBindPose[i])[3]);
+
+  //the farthest vertex or joint which moves with the joint
+  std::vector<float> reach(n, 0.f);
+  auto extend_reach = [&](int joint, const vec3 &p)
+  {
+    for (int i = joint; i >= 0; i = parents[i])
+      reach[i] = glm::max(reach[i], length(p - jointPositions[i]));
+  };
+  for (int i = 0; i < n; i++)
+    extend_reach(i, jointPositions[i]);
+  for (size_t i = 0; i < points.size(); i++)
+    extend_reach(point_joints[i], points[i]);
+
+  //without clips assume every joint can turn by 60 degrees
+  std::vector<float> maxAngle(n, clips.empty() ? PI / 3.f : 0.f);
+  std::vector<float> maxShift(n, 0.f);
+  for (const AnimationClipPtr &clip : clips)
+    for (int frame = 0; frame < clip->frameCount; frame++)
+    {
+      const vec3 *translations = clip->frame_translations(frame);
+      const quat *rotations = clip->frame_rotations(frame);
+      for (int i = 0; i < n; i++)
+      {
+        float cosHalfAngle = glm::min(glm::abs(dot(rotations[i], skeleton.bindRotations[i])), 1.f);
+        maxAngle[i] = glm::max(maxAngle[i], 2.f * acos(cosHalfAngle));
+        maxShift[i] = glm::max(maxShift[i], length(translations[i] - skeleton.bindTranslations[i]));
+      }
+    }
+
+  //collapsing a joint collapses all its children too, so error of the parent includes children errors
+  std::vector<float> error(n, 0.f);
+  float skeletonSize = 0.f;
+  for (int i = n - 1; i >= 0; i--)
+  {
+    error[i] += reach[i] * 2.f * sin(0.5f * maxAngle[i]) + maxShift[i];
+    if (parents[i] >= 0)
+      error[parents[i]] = glm::max(error[parents[i]], error[i]);
+    else
+      skeletonSize = glm::max(skeletonSize, reach[i]);
+  }
+  for (int i = 0; i < n; i++)
+    if (parents[i] < 0)
+      error[i] = FLT_MAX;
+
+  std::vector<int> lodCount(n, 1);
+  for (int i = 0; i < n; i++)
+    for (int lod = 1; lod < MaxSkeletonLods; lod++)
+      if (error[i] > settings.relativeError[lod] * skeletonSize)
+        lodCount[i]++;
+
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return lodCount[a] > lodCount[b]; });
+
+  std::vector<int> oldToNew(n);
+  for (int i = 0; i < n; i++)
+    oldToNew[order[i]] = i;
+
+  skeleton.lodCount = MaxSkeletonLods;
+  for (int lod = 0; lod < MaxSkeletonLods; lod++)
+  {
+    skeleton.lodJointCount[lod] = 0;
+    skeleton.lodError[lod] = 0.f;
+    for (int i = 0; i < n; i++)
+    {
+      if (lodCount[i] > lod)
+        skeleton.lodJointCount[lod]++;
+      else
+        skeleton.lodError[lod] = glm::max(skeleton.lodError[lod], error[i]);
+    }
+  }
+
+  permute(skeleton.names, order, n);
+  permute(skeleton.parents, order, n);
+  permute(skeleton.bindTranslations, order, n);
+  permute(skeleton.bindRotations, order, n);
+  permute(skeleton.bindScales, order, n);
+  permute(skeleton.inverseBindPose, order, n);
+  for (int &parent : skeleton.parents)
+    if (parent >= 0)
+      parent = oldToNew[parent];
+
+  for (AnimationClipPtr &clip : clips)
+  {
+    permute(clip->translations, order, n);
+    permute(clip->rotations, order, n);
+    permute(clip->scales, order, n);
+  }
+
+  debug_log("skeleton lods: %d %d %d %d joints", skeleton.lodJointCount[0], skeleton.lodJointCount[1],
+    skeleton.lodJointCount[2], skeleton.lodJointCount[3]);
+  return oldToNew;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "3dmath.h"
+#include "animation.h"
+#include <vector>
+#include <string>
+#include <memory>
+
+constexpr int MaxSkeletonLods = 4;
+
+//joints are stored parent first and sorted by lod,
+//so the joints of every lod are a prefix of all arrays
+struct Skeleton
+{
+  std::vector<std::string> names;
+  std::vector<int> parents;
+  std::vector<vec3> bindTranslations;
+  std::vector<quat> bindRotations;
+  std::vector<vec3> bindScales;
+  std::vector<mat4> inverseBindPose;
+
+  int lodCount = 1;
+  int lodJointCount[MaxSkeletonLods] = {};
+  //max model space error (in meters) of the joints collapsed at each lod
+  float lodError[MaxSkeletonLods] = {};
+
+  int joint_count() const { return (int)names.size(); }
+  int find_joint(const char *name) const;
+};
+
+using SkeletonPtr = std::shared_ptr<Skeleton>;
+
+struct SkeletonLodSettings
+{
+  //collapse thresholds relative to the skeleton size, lod 0 always keeps all joints
+  float relativeError[MaxSkeletonLods] = {0.f, 0.01f, 0.03f, 0.08f};
+};
+
+//coarsest lod which error is still less than tolerance (in radians of view angle)
+int select_skeleton_lod(const Skeleton &skeleton, float distance, float tolerance);
+
+//estimates the error of collapsing every joint into its parent from joint reach (points are skinned
+//vertices attached to their main joint) and clip motion, then sorts skeleton and clips by lods
+//returns old joint index -> new joint index
+std::vector<int> build_skeleton_lods(
+  Skeleton &skeleton,
+  std::vector<AnimationClipPtr> &clips,
+  const std::vector<vec3> &points,
+  const std::vector<int> &point_joints,
+  const SkeletonLodSettings &settings);
@@ -0,0 +1,328 @@
+#include "skinned_raycast.h"
+#include <algorithm>
+#include <assimp/scene.h>
+
+static int build_bvh(
+  std::vector<SkinnedBvhNode> &nodes,
+  std::vector<uvec3> &triangles,
+  const std::vector<vec3> &centroids,
+  std::vector<int> &order,
+  const std::vector<vec3> &positions,
+  int begin,
+  int end)
+{
+  int index = nodes.size();
+  nodes.push_back(SkinnedBvhNode{BoundingBox(), begin, end - begin});
+  BoundingBox box, centroidBox;
+  for (int i = begin; i < end; i++)
+  {
+    const uvec3 &triangle = triangles[order[i]];
+    for (int j = 0; j < 3; j++)
+      box.add(positions[triangle[j]]);
+    centroidBox.add(centroids[order[i]]);
+  }
+  nodes[index].box = box;
+  if (end - begin <= SkinnedBvhLeafSize)
+    return index;
+
+  //median split along the longest axis of the centroids
+  vec3 extent = centroidBox.max - centroidBox.min;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  int middle = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+    [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+  build_bvh(nodes, triangles, centroids, order, positions, begin, middle);
+  int right = build_bvh(nodes, triangles, centroids, order, positions, middle, end);
+  nodes[index].offset = right;
+  nodes[index].count = 0;
+  return index;
+}
+
+static JointCapsule fit_capsule(int joint, const std::vector<vec3> &points, float margin)
+{
+  BoundingBox box;
+  for (const vec3 &p : points)
+    box.add(p);
+  vec3 extent = box.max - box.min;
+  vec3 center = (box.min + box.max) * 0.5f;
+  int longest = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  vec3 axis = vec3(0.f);
+  axis[longest] = 1.f;
+  //all projections are inside the segment, so the radius is the farthest distance to the line
+  float radius = 0.f;
+  for (const vec3 &p : points)
+  {
+    vec3 offset = p - center;
+    radius = glm::max(radius, length(offset - axis * dot(offset, axis)));
+  }
+  vec3 half = axis * (extent[longest] * 0.5f);
+  return JointCapsule{joint, center - half, center + half, radius + margin};
+}
+
+SkinnedRaycastModelPtr make_skinned_raycast_model(
+  const aiMesh *mesh,
+  const Skeleton &skeleton,
+  const std::vector<int> &bone_joints,
+  float capsule_margin)
+{
+  auto model = std::make_shared<SkinnedRaycastModel>();
+  int numVert = mesh->mNumVertices;
+  model->positions.resize(numVert);
+  for (int i = 0; i < numVert; i++)
+    model->positions[i] = to_vec3(mesh->mVertices[i]);
+
+  //the same four weights as the vertex shader gets, see create_mesh
+  model->weights.assign(numVert, vec4(0.f));
+  model->joints.assign(numVert, ivec4(0));
+  std::vector<int> weightsOffset(numVert, 0);
+  std::vector<std::vector<vec3>> jointPoints(skeleton.joint_count());
+  for (unsigned i = 0; i < mesh->mNumBones; i++)
+  {
+    const aiBone *bone = mesh->mBones[i];
+    int joint = bone_joints[i];
+    for (unsigned j = 0; j < bone->mNumWeights; j++)
+    {
+      int vertex = bone->mWeights[j].mVertexId;
+      if (weightsOffset[vertex] < 4)
+      {
+        int offset = weightsOffset[vertex]++;
+        model->weights[vertex][offset] = bone->mWeights[j].mWeight;
+        model->joints[vertex][offset] = joint;
+      }
+      if (bone->mWeights[j].mWeight > 0.f)
+        jointPoints[joint].push_back(vec3(skeleton.inverseBindPose[joint] * vec4(model->positions[vertex], 1.f)));
+    }
+  }
+  for (vec4 &w : model->weights)
+  {
+    float s = w.x + w.y + w.z + w.w;
+    w = s > 0.f ? w / s : vec4(1.f, 0.f, 0.f, 0.f);
+  }
+
+  for (int i = 0, n = jointPoints.size(); i < n; i++)
+    if (!jointPoints[i].empty())
+    {
+      model->capsules.push_back(fit_capsule(i, jointPoints[i], capsule_margin));
+      model->capsuleBindPose.push_back(inverse(skeleton.inverseBindPose[i]));
+    }
+
+  int numFaces = mesh->mNumFaces;
+  std::vector<uvec3> triangles(numFaces);
+  std::vector<vec3> centroids(numFaces);
+  std::vector<int> order(numFaces);
+  for (int i = 0; i < numFaces; i++)
+  {
+    const aiFace &face = mesh->mFaces[i];
+    triangles[i] = uvec3(face.mIndices[0], face.mIndices[1], face.mIndices[2]);
+    centroids[i] = (model->positions[triangles[i].x] + model->positions[triangles[i].y] + model->positions[triangles[i].z]) / 3.f;
+    order[i] = i;
+  }
+  if (numFaces > 0)
+    build_bvh(model->nodes, triangles, centroids, order, model->positions, 0, numFaces);
+  model->triangles.resize(numFaces);
+  for (int i = 0; i < numFaces; i++)
+    model->triangles[i] = triangles[order[i]];
+  return model;
+}
+
+//closest points of segments p0 + s * d0 and p1 + t * d1, s and t in [0, 1]
+static float segment_distance_squared(const vec3 &p0, const vec3 &d0, const vec3 &p1, const vec3 &d1)
+{
+  const float epsilon = 1e-12f;
+  vec3 r = p0 - p1;
+  float a = dot(d0, d0), e = dot(d1, d1), f = dot(d1, r);
+  float s = 0.f, t = 0.f;
+  if (a <= epsilon && e <= epsilon)
+    return dot(r, r);
+  if (a <= epsilon)
+    t = glm::clamp(f / e, 0.f, 1.f);
+  else
+  {
+    float c = dot(d0, r);
+    if (e <= epsilon)
+      s = glm::clamp(-c / a, 0.f, 1.f);
+    else
+    {
+      float b = dot(d0, d1);
+      float denom = a * e - b * b;
+      s = denom > epsilon ? glm::clamp((b * f - c * e) / denom, 0.f, 1.f) : 0.f;
+      t = (b * s + f) / e;
+      if (t < 0.f)
+      {
+        t = 0.f;
+        s = glm::clamp(-c / a, 0.f, 1.f);
+      }
+      else if (t > 1.f)
+      {
+        t = 1.f;
+        s = glm::clamp((b - c) / a, 0.f, 1.f);
+      }
+    }
+  }
+  vec3 d = (p0 + d0 * s) - (p1 + d1 * t);
+  return dot(d, d);
+}
+
+bool raycast_joint_capsules(const SkinnedRaycastModel &model, const mat4 *palette, const vec3 &origin, const vec3 &direction, float max_distance)
+{
+  float lengthSquared = dot(direction, direction);
+  if (lengthSquared <= 0.f || std::isnan(max_distance))
+    return false;
+  float directionLength = sqrt(lengthSquared);
+  for (int i = 0, n = model.capsules.size(); i < n; i++)
+  {
+    const JointCapsule &capsule = model.capsules[i];
+    mat4 m = palette[capsule.joint] * model.capsuleBindPose[i];
+    vec3 start = vec3(m * vec4(capsule.start, 1.f));
+    vec3 end = vec3(m * vec4(capsule.end, 1.f));
+    float scale = glm::max(length(vec3(m[0])), glm::max(length(vec3(m[1])), length(vec3(m[2]))));
+    float radius = capsule.radius * scale;
+    //farthest ray parameter which can still touch the capsule, keeps the segment finite
+    float farthest = (glm::max(dot(start - origin, direction), dot(end - origin, direction)) + radius * directionLength) / lengthSquared;
+    float distance = glm::min(max_distance, farthest);
+    if (distance < 0.f)
+      continue;
+    if (segment_distance_squared(origin, direction * distance, start, end - start) <= radius * radius)
+      return true;
+  }
+  return false;
+}
+
+void refit_skinned_bvh(const SkinnedRaycastModel &model, const mat4 *palette, int version, SkinnedRaycastState &state)
+{
+  if (state.version == version && !state.nodes.empty())
+    return;
+  state.version = version;
+  int numVert = model.positions.size();
+  state.positions.resize(numVert);
+  for (int i = 0; i < numVert; i++)
+  {
+    const vec4 &w = model.weights[i];
+    const ivec4 &j = model.joints[i];
+    mat4 skin = palette[j.x] * w.x + palette[j.y] * w.y + palette[j.z] * w.z + palette[j.w] * w.w;
+    state.positions[i] = vec3(skin * vec4(model.positions[i], 1.f));
+  }
+
+  //children are always after their parent, so a reverse pass sees them refitted
+  state.nodes = model.nodes;
+  for (int i = state.nodes.size() - 1; i >= 0; i--)
+  {
+    SkinnedBvhNode &node = state.nodes[i];
+    node.box = BoundingBox();
+    if (node.count > 0)
+    {
+      for (int k = node.offset; k < node.offset + node.count; k++)
+        for (int v = 0; v < 3; v++)
+          node.box.add(state.positions[model.triangles[k][v]]);
+    }
+    else
+    {
+      node.box.add(state.nodes[i + 1].box);
+      node.box.add(state.nodes[node.offset].box);
+    }
+  }
+}
+
+bool ray_box_intersection(const BoundingBox &box, const vec3 &origin, const vec3 &inv_direction, float max_distance, float &distance)
+{
+  float exit;
+  return ray_box_intersection(box, origin, inv_direction, max_distance, distance, exit);
+}
+
+bool ray_box_intersection(const BoundingBox &box, const vec3 &origin, const vec3 &inv_direction, float max_distance, float &distance, float &exit_distance)
+{
+  vec3 t0 = (box.min - origin) * inv_direction;
+  vec3 t1 = (box.max - origin) * inv_direction;
+  vec3 tmin = glm::min(t0, t1), tmax = glm::max(t0, t1);
+  float enter = glm::max(glm::max(tmin.x, tmin.y), glm::max(tmin.z, 0.f));
+  float exit = glm::min(glm::min(tmax.x, tmax.y), glm::min(tmax.z, max_distance));
+  distance = enter;
+  exit_distance = exit;
+  return enter <= exit;
+}
+
+//two sided moller-trumbore
+static bool ray_triangle_intersection(const vec3 &origin, const vec3 &direction, const vec3 &a, const vec3 &b, const vec3 &c, float &distance)
+{
+  vec3 ab = b - a, ac = c - a;
+  vec3 p = cross(direction, ac);
+  float det = dot(ab, p);
+  if (glm::abs(det) < 1e-12f)
+    return false;
+  float invDet = 1.f / det;
+  vec3 s = origin - a;
+  float u = dot(s, p) * invDet;
+  if (u < 0.f || u > 1.f)
+    return false;
+  vec3 q = cross(s, ab);
+  float v = dot(direction, q) * invDet;
+  if (v < 0.f || u + v > 1.f)
+    return false;
+  distance = dot(ac, q) * invDet;
+  return distance >= 0.f;
+}
+
+static bool raycast_triangles(const SkinnedRaycastModel &model, const SkinnedRaycastState &state, int begin, int end, const vec3 &origin, const vec3 &direction, RayHit &hit)
+{
+  bool result = false;
+  for (int i = begin; i < end; i++)
+  {
+    const uvec3 &triangle = model.triangles[i];
+    float distance;
+    if (ray_triangle_intersection(origin, direction, state.positions[triangle.x], state.positions[triangle.y], state.positions[triangle.z], distance) &&
+        distance < hit.distance)
+    {
+      hit.distance = distance;
+      hit.triangle = i;
+      result = true;
+    }
+  }
+  return result;
+}
+
+bool raycast_skinned_mesh(const SkinnedRaycastModel &model, const SkinnedRaycastState &state, const vec3 &origin, const vec3 &direction, RayHit &hit)
+{
+  const std::vector<SkinnedBvhNode> &nodes = state.nodes;
+  if (nodes.empty())
+    return false;
+  vec3 invDirection = 1.f / direction;
+  bool result = false;
+  int stack[64];
+  int stackSize = 0;
+  float distance;
+  if (ray_box_intersection(nodes[0].box, origin, invDirection, hit.distance, distance))
+    stack[stackSize++] = 0;
+  while (stackSize > 0)
+  {
+    const SkinnedBvhNode &node = nodes[stack[--stackSize]];
+    if (node.count > 0)
+    {
+      result |= raycast_triangles(model, state, node.offset, node.offset + node.count, origin, direction, hit);
+      continue;
+    }
+    int left = &node - nodes.data() + 1, right = node.offset;
+    float leftDistance, rightDistance;
+    bool hitLeft = ray_box_intersection(nodes[left].box, origin, invDirection, hit.distance, leftDistance);
+    bool hitRight = ray_box_intersection(nodes[right].box, origin, invDirection, hit.distance, rightDistance);
+    //the nearer child is popped first, so the farther one is often skipped by the shortened ray
+    if (hitLeft && hitRight && leftDistance < rightDistance)
+    {
+      stack[stackSize++] = right;
+      stack[stackSize++] = left;
+    }
+    else
+    {
+      if (hitLeft)
+        stack[stackSize++] = left;
+      if (hitRight)
+        stack[stackSize++] = right;
+    }
+  }
+  return result;
+}
+
+bool raycast_skinned_mesh_brute_force(const SkinnedRaycastModel &model, const SkinnedRaycastState &state, const vec3 &origin, const vec3 &direction, RayHit &hit)
+{
+  return raycast_triangles(model, state, 0, model.triangles.size(), origin, direction, hit);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "skeleton.h"
+#include "bounds.h"
+
+struct aiMesh;
+
+constexpr int SkinnedBvhLeafSize = 4;
+
+//leaves have count triangles from offset, inner nodes have the left child next and the right one at offset
+struct SkinnedBvhNode
+{
+  BoundingBox box;
+  int offset;
+  int count;
+};
+
+//capsule around the vertices influenced by the joint, points are in the joint space
+struct JointCapsule
+{
+  int joint;
+  vec3 start, end;
+  float radius;
+};
+
+//bind pose geometry for cpu skinning and the triangle bvh built once on it, shared by characters
+struct SkinnedRaycastModel
+{
+  std::vector<vec3> positions;
+  std::vector<vec4> weights;
+  std::vector<ivec4> joints;
+  //triangles in the bvh leaf order
+  std::vector<uvec3> triangles;
+  std::vector<SkinnedBvhNode> nodes;
+  std::vector<JointCapsule> capsules;
+  //joint to mesh bind space for every capsule
+  std::vector<mat4> capsuleBindPose;
+};
+
+using SkinnedRaycastModelPtr = std::shared_ptr<SkinnedRaycastModel>;
+
+//bone_joints maps aiMesh bones to skeleton joints, capsule_margin is added to the capsule radii
+//because blended vertices between joints can leave the capsules of both
+SkinnedRaycastModelPtr make_skinned_raycast_model(
+  const aiMesh *mesh,
+  const Skeleton &skeleton,
+  const std::vector<int> &bone_joints,
+  float capsule_margin = 0.05f);
+
+//skinned positions and refitted nodes of one character
+struct SkinnedRaycastState
+{
+  std::vector<vec3> positions;
+  std::vector<SkinnedBvhNode> nodes;
+  //refit_skinned_bvh does nothing when called again with the same version
+  int version = -1;
+};
+
+struct RayHit
+{
+  float distance = FLT_MAX;
+  int triangle = -1;
+};
+
+//rays are in the model space of the palette, direction doesn't need to be normalized
+
+//coarse test against the capsules in the current pose, the ray is cut behind every capsule,
+//so max_distance can be FLT_MAX or infinity
+bool raycast_joint_capsules(const SkinnedRaycastModel &model, const mat4 *palette, const vec3 &origin, const vec3 &direction, float max_distance);
+
+//skins all vertices with the palette and refits the boxes bottom up, the tree topology stays from the bind pose
+void refit_skinned_bvh(const SkinnedRaycastModel &model, const mat4 *palette, int version, SkinnedRaycastState &state);
+
+//nearest hit closer than hit.distance, needs a refitted state
+bool raycast_skinned_mesh(const SkinnedRaycastModel &model, const SkinnedRaycastState &state, const vec3 &origin, const vec3 &direction, RayHit &hit);
+
+//every triangle of the skinned positions, for reference
+bool raycast_skinned_mesh_brute_force(const SkinnedRaycastModel &model, const SkinnedRaycastState &state, const vec3 &origin, const vec3 &direction, RayHit &hit);
+
+//slab test, distance is where the ray enters the box
+bool ray_box_intersection(const BoundingBox &box, const vec3 &origin, const vec3 &inv_direction, float max_distance, float &distance);
+
+//also returns where the ray leaves the box, clamped to max_distance
+bool ray_box_intersection(const BoundingBox &box, const vec3 &origin, const vec3 &inv_direction, float max_distance, float &distance, float &exit_distance);
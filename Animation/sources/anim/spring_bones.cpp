@@ -0,0 +1,229 @@
+#include "spring_bones.h"
+#include "vec3x4.h"
+#include <log.h>
+
+SpringCollider make_spring_collider(const Skeleton &skeleton, const char *joint, const char *end_joint, float radius)
+{
+  SpringCollider collider{skeleton.find_joint(joint), vec3(0.f), vec3(0.f), radius};
+  if (collider.joint < 0)
+    debug_error("spring bones: skeleton doesn't have %s joint", joint);
+  int endJoint = end_joint ? skeleton.find_joint(end_joint) : -1;
+  if (collider.joint >= 0 && endJoint >= 0)
+  {
+    //inverse bind pose goes from the mesh space to the joint space
+    vec4 end = inverse(skeleton.inverseBindPose[endJoint])[3];
+    collider.end = vec3(skeleton.inverseBindPose[collider.joint] * end);
+  }
+  return collider;
+}
+
+static int first_child(const Skeleton &skeleton, int joint)
+{
+  for (int i = joint + 1, n = skeleton.joint_count(); i < n; i++)
+    if (skeleton.parents[i] == joint)
+      return i;
+  return -1;
+}
+
+SpringBoneSystemPtr make_spring_bone_system(
+  const Skeleton &skeleton,
+  const SpringBoneSettings &settings,
+  const std::vector<SpringCollider> &colliders,
+  int character_count)
+{
+  auto system = std::make_shared<SpringBoneSystem>();
+  system->settings = settings;
+  system->characterCount = character_count;
+  system->capacity = (character_count + IkLanes - 1) / IkLanes * IkLanes;
+  int capacity = system->capacity;
+
+  for (const SpringCollider &collider : colliders)
+    if (collider.joint >= 0 && (int)system->colliders.size() < MaxSpringColliders)
+      system->colliders.push_back(collider);
+  system->colliderStarts.assign(system->colliders.size() * 3 * capacity, 0.f);
+  system->colliderEnds.assign(system->colliders.size() * 3 * capacity, 0.f);
+
+  for (const std::string &root : settings.chainRoots)
+  {
+    SpringChainState state;
+    for (int joint = skeleton.find_joint(root.c_str()); joint >= 0 && (int)state.chain.joints.size() < MaxIkChainLength;
+      joint = first_child(skeleton, joint))
+      state.chain.joints.push_back(joint);
+    int n = state.chain.joints.size();
+    if (n < 2)
+    {
+      debug_error("spring bones: %s doesn't start a chain", root.c_str());
+      continue;
+    }
+    state.positions.assign(n * 3 * capacity, 0.f);
+    state.prevPositions.assign(n * 3 * capacity, 0.f);
+    state.targets.assign(n * 3 * capacity, 0.f);
+    state.lengths.assign((n - 1) * capacity, 0.f);
+    state.reset.assign(capacity, 1);
+    system->chains.push_back(std::move(state));
+  }
+  return system;
+}
+
+static void store_vec3(std::vector<float> &rows, int row, int capacity, int character, const vec3 &v)
+{
+  for (int axis = 0; axis < 3; axis++)
+    rows[(row * 3 + axis) * capacity + character] = v[axis];
+}
+
+void set_spring_bone_character(SpringBoneSystem &system, int character, const mat4 &transform, const mat4 *model, int joint_count)
+{
+  int capacity = system.capacity;
+  for (SpringChainState &state : system.chains)
+  {
+    const std::vector<int> &joints = state.chain.joints;
+    int n = joints.size();
+    if (joints.back() >= joint_count)
+    {
+      state.reset[character] = 1;
+      continue;
+    }
+    vec3 prevTarget;
+    for (int i = 0; i < n; i++)
+    {
+      vec3 target = vec3(transform * model[joints[i]][3]);
+      store_vec3(state.targets, i, capacity, character, target);
+      if (i > 0)
+        state.lengths[(i - 1) * capacity + character] = length(target - prevTarget);
+      if (state.reset[character])
+      {
+        store_vec3(state.positions, i, capacity, character, target);
+        store_vec3(state.prevPositions, i, capacity, character, target);
+      }
+      prevTarget = target;
+    }
+    state.reset[character] = 0;
+  }
+
+  for (int i = 0, n = system.colliders.size(); i < n; i++)
+  {
+    const SpringCollider &collider = system.colliders[i];
+    mat4 colliderTransform = transform * model[collider.joint];
+    store_vec3(system.colliderStarts, i, capacity, character, vec3(colliderTransform * vec4(collider.start, 1.f)));
+    store_vec3(system.colliderEnds, i, capacity, character, vec3(colliderTransform * vec4(collider.end, 1.f)));
+  }
+}
+
+//pushes the particle out of the capsule
+static Vec3x4 collide(const Vec3x4 &p, const Vec3x4 &start, const Vec3x4 &end, __m128 radius)
+{
+  Vec3x4 axis = sub(end, start);
+  __m128 t = _mm_div_ps(dot(sub(p, start), axis), _mm_max_ps(dot(axis, axis), _mm_set1_ps(1e-12f)));
+  t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.f));
+  Vec3x4 offset = sub(p, add(start, mul(axis, t)));
+  __m128 distance = length(offset);
+  __m128 inside = _mm_cmplt_ps(distance, radius);
+  Vec3x4 pushed = add(p, mul(normalize(offset), _mm_sub_ps(radius, distance)));
+  return select(inside, pushed, p);
+}
+
+void reset_spring_bone_character(SpringBoneSystem &system, int character)
+{
+  for (SpringChainState &state : system.chains)
+    state.reset[character] = 1;
+}
+
+void simulate_spring_bones(SpringBoneSystem &system, float dt)
+{
+  const SpringBoneSettings &settings = system.settings;
+  system.accumulator += dt;
+  int substeps = glm::min(int(system.accumulator * settings.substepRate), settings.maxSubsteps);
+  //too long frames drop time instead of spiraling
+  system.accumulator = substeps < settings.maxSubsteps ? system.accumulator - substeps / settings.substepRate : 0.f;
+  if (substeps == 0)
+    return;
+
+  float h = 1.f / settings.substepRate;
+  int capacity = system.capacity;
+  int colliderCount = system.colliders.size();
+  const __m128 keep = _mm_set1_ps(1.f - settings.damping);
+  const __m128 stiffness = _mm_set1_ps(settings.stiffness);
+  const Vec3x4 gravity = {
+    _mm_set1_ps(settings.gravity.x * h * h),
+    _mm_set1_ps(settings.gravity.y * h * h),
+    _mm_set1_ps(settings.gravity.z * h * h)};
+
+  Vec3x4 p[MaxIkChainLength], prev[MaxIkChainLength], target[MaxIkChainLength];
+  __m128 lengths[MaxIkChainLength];
+  Vec3x4 starts[MaxSpringColliders], ends[MaxSpringColliders];
+  __m128 radii[MaxSpringColliders];
+  for (int i = 0; i < colliderCount; i++)
+    radii[i] = _mm_set1_ps(system.colliders[i].radius + settings.particleRadius);
+
+  for (SpringChainState &state : system.chains)
+  {
+    int n = state.chain.joints.size();
+    for (int lane = 0; lane < capacity; lane += IkLanes)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        p[i] = load(&state.positions[i * 3 * capacity], capacity, lane);
+        prev[i] = load(&state.prevPositions[i * 3 * capacity], capacity, lane);
+        target[i] = load(&state.targets[i * 3 * capacity], capacity, lane);
+      }
+      for (int i = 0; i + 1 < n; i++)
+        lengths[i] = _mm_loadu_ps(&state.lengths[i * capacity + lane]);
+      for (int i = 0; i < colliderCount; i++)
+      {
+        starts[i] = load(&system.colliderStarts[i * 3 * capacity], capacity, lane);
+        ends[i] = load(&system.colliderEnds[i * 3 * capacity], capacity, lane);
+      }
+
+      for (int step = 0; step < substeps; step++)
+      {
+        p[0] = prev[0] = target[0];
+        for (int i = 1; i < n; i++)
+        {
+          Vec3x4 velocity = mul(sub(p[i], prev[i]), keep);
+          prev[i] = p[i];
+          p[i] = add(p[i], add(velocity, gravity));
+          p[i] = add(p[i], mul(sub(target[i], p[i]), stiffness));
+        }
+        for (int i = 1; i < n; i++)
+        {
+          for (int j = 0; j < colliderCount; j++)
+            p[i] = collide(p[i], starts[j], ends[j], radii[j]);
+          p[i] = add(p[i - 1], mul(normalize(sub(p[i], p[i - 1])), lengths[i - 1]));
+        }
+      }
+
+      for (int i = 0; i < n; i++)
+      {
+        store(p[i], &state.positions[i * 3 * capacity], capacity, lane);
+        store(prev[i], &state.prevPositions[i * 3 * capacity], capacity, lane);
+      }
+    }
+  }
+}
+
+void apply_spring_bones(
+  const SpringBoneSystem &system,
+  int character,
+  const Skeleton &skeleton,
+  const mat4 &transform,
+  int joint_count,
+  Pose &pose,
+  mat4 *model)
+{
+  mat4 toModel = inverse(transform);
+  int capacity = system.capacity;
+  vec3 positions[MaxIkChainLength];
+  for (const SpringChainState &state : system.chains)
+  {
+    if (state.reset[character])
+      continue;
+    for (int i = 0, n = state.chain.joints.size(); i < n; i++)
+    {
+      vec3 world;
+      for (int axis = 0; axis < 3; axis++)
+        world[axis] = state.positions[(i * 3 + axis) * capacity + character];
+      positions[i] = vec3(toModel * vec4(world, 1.f));
+    }
+    apply_ik_chain(skeleton, state.chain, positions, joint_count, pose, model);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "ik.h"
+
+constexpr int MaxSpringColliders = 16;
+
+//sphere when the end equals the start, points are in the joint space
+struct SpringCollider
+{
+  int joint;
+  vec3 start, end;
+  float radius;
+};
+
+//capsule from the joint to end_joint (sphere if end_joint is null) in the bind pose
+SpringCollider make_spring_collider(const Skeleton &skeleton, const char *joint, const char *end_joint, float radius);
+
+struct SpringBoneSettings
+{
+  //the root stays animated, the chain follows first children down to a leaf
+  std::vector<std::string> chainRoots;
+  //fraction of the offset to the animated pose removed every substep
+  float stiffness = 0.05f;
+  //fraction of the velocity lost every substep
+  float damping = 0.05f;
+  vec3 gravity = vec3(0.f, -9.8f, 0.f);
+  float particleRadius = 0.01f;
+  float substepRate = 120.f;
+  int maxSubsteps = 4;
+};
+
+//verlet particles of one chain for all characters, [joint][x, y, z][character] like IkBatch
+struct SpringChainState
+{
+  IkChain chain;
+  std::vector<float> positions;
+  std::vector<float> prevPositions;
+  std::vector<float> targets;
+  std::vector<float> lengths;
+  //characters which particles must be reset to the animated pose
+  std::vector<char> reset;
+};
+
+//all chains of all characters with one skeleton, simulated in world space
+struct SpringBoneSystem
+{
+  SpringBoneSettings settings;
+  std::vector<SpringCollider> colliders;
+  std::vector<SpringChainState> chains;
+  int characterCount = 0;
+  //characterCount padded to IkLanes
+  int capacity = 0;
+  //world space capsules, [collider][x, y, z][character]
+  std::vector<float> colliderStarts;
+  std::vector<float> colliderEnds;
+  float accumulator = 0.f;
+};
+
+using SpringBoneSystemPtr = std::shared_ptr<SpringBoneSystem>;
+
+SpringBoneSystemPtr make_spring_bone_system(
+  const Skeleton &skeleton,
+  const SpringBoneSettings &settings,
+  const std::vector<SpringCollider> &colliders,
+  int character_count);
+
+//animated targets and colliders of the character after the hierarchy pass, chains collapsed
+//by the skeleton lod are reset to the animated pose when they are evaluated again
+void set_spring_bone_character(SpringBoneSystem &system, int character, const mat4 &transform, const mat4 *model, int joint_count);
+
+//for characters which weren't evaluated this frame, their chains restart from the animated pose
+void reset_spring_bone_character(SpringBoneSystem &system, int character);
+
+//fixed substeps, leftover time is carried to the next frame
+void simulate_spring_bones(SpringBoneSystem &system, float dt);
+
+//rotates chain joints to the simulated particles, like apply_ik_chain
+void apply_spring_bones(
+  const SpringBoneSystem &system,
+  int character,
+  const Skeleton &skeleton,
+  const mat4 &transform,
+  int joint_count,
+  Pose &pose,
+  mat4 *model);
@@ -0,0 +1,70 @@
+#pragma once
+#include <immintrin.h>
+
+//four vec3 in sse registers by coordinates, used by solvers which process characters in simd lanes
+struct Vec3x4
+{
+  __m128 x, y, z;
+};
+
+//rows are x, y, z arrays of capacity floats, lane is the first of four consecutive elements
+inline Vec3x4 load(const float *rows, int capacity, int lane)
+{
+  return Vec3x4{_mm_loadu_ps(rows + lane), _mm_loadu_ps(rows + capacity + lane), _mm_loadu_ps(rows + 2 * capacity + lane)};
+}
+
+inline void store(const Vec3x4 &v, float *rows, int capacity, int lane)
+{
+  _mm_storeu_ps(rows + lane, v.x);
+  _mm_storeu_ps(rows + capacity + lane, v.y);
+  _mm_storeu_ps(rows + 2 * capacity + lane, v.z);
+}
+
+inline Vec3x4 add(const Vec3x4 &a, const Vec3x4 &b)
+{
+  return Vec3x4{_mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z)};
+}
+
+inline Vec3x4 sub(const Vec3x4 &a, const Vec3x4 &b)
+{
+  return Vec3x4{_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z)};
+}
+
+inline Vec3x4 mul(const Vec3x4 &a, __m128 s)
+{
+  return Vec3x4{_mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s)};
+}
+
+inline __m128 dot(const Vec3x4 &a, const Vec3x4 &b)
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+inline Vec3x4 cross(const Vec3x4 &a, const Vec3x4 &b)
+{
+  return Vec3x4{
+    _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+    _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+    _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x))};
+}
+
+inline __m128 length(const Vec3x4 &a)
+{
+  return _mm_sqrt_ps(dot(a, a));
+}
+
+//zero vectors stay zero
+inline Vec3x4 normalize(const Vec3x4 &a)
+{
+  return mul(a, _mm_div_ps(_mm_set1_ps(1.f), _mm_max_ps(length(a), _mm_set1_ps(1e-6f))));
+}
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline Vec3x4 select(__m128 mask, const Vec3x4 &a, const Vec3x4 &b)
+{
+  return Vec3x4{select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z)};
+}
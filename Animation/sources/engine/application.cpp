@@ -1,4 +1,5 @@
 #include "application.h"
+#include "job_system.h"
 #include <glad/glad.h>
 #include <imgui/imgui_impl_opengl3.h>
 #include <imgui/imgui_impl_sdl.h>
@@ -7,6 +8,7 @@
 extern void game_init();
 extern void game_update();
 extern void game_render();
+extern void game_imgui();
 extern void start_time();
 extern void update_time();
 
@@ -49,10 +51,13 @@ void init_application(const char *project_name, int width, int height, bool full
   const char *glsl_version = "#version 450";
   ImGui_ImplOpenGL3_Init(glsl_version);
   glEnable(GL_DEBUG_OUTPUT);
+
+  init_job_system();
 }
 
 void close_application()
 {
+  close_job_system();
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplSDL2_Shutdown();
   ImGui::DestroyContext();
@@ -118,6 +123,7 @@ void main_loop()
         {
           ImGui::EndMainMenuBar();
         }
+        game_imgui();
       }
 
       ImGui::Render();
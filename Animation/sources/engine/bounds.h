@@ -0,0 +1,66 @@
+#pragma once
+#include "3dmath.h"
+#include <cfloat>
+
+struct BoundingBox
+{
+  vec3 min = vec3(FLT_MAX);
+  vec3 max = vec3(-FLT_MAX);
+
+  bool empty() const { return min.x > max.x; }
+  void add(const vec3 &p)
+  {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void add(const vec3 &center, float radius)
+  {
+    min = glm::min(min, center - vec3(radius));
+    max = glm::max(max, center + vec3(radius));
+  }
+  void add(const BoundingBox &box)
+  {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+};
+
+inline BoundingBox transform_bounds(const mat4 &transform, const BoundingBox &box)
+{
+  vec3 center = vec3(transform * vec4((box.min + box.max) * 0.5f, 1.f));
+  vec3 extent = (box.max - box.min) * 0.5f;
+  mat3 absTransform = mat3(abs(vec3(transform[0])), abs(vec3(transform[1])), abs(vec3(transform[2])));
+  extent = absTransform * extent;
+  return BoundingBox{center - extent, center + extent};
+}
+
+//planes point inside, xyz is normalized
+struct Frustum
+{
+  vec4 planes[6];
+};
+
+inline Frustum extract_frustum(const mat4 &view_projection)
+{
+  mat4 rows = transpose(view_projection);
+  Frustum frustum;
+  for (int i = 0; i < 3; i++)
+  {
+    frustum.planes[i * 2] = rows[3] + rows[i];
+    frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+  }
+  for (vec4 &plane : frustum.planes)
+    plane /= length(vec3(plane));
+  return frustum;
+}
+
+inline bool is_visible(const Frustum &frustum, const BoundingBox &box)
+{
+  for (const vec4 &plane : frustum.planes)
+  {
+    vec3 farthest = mix(box.min, box.max, greaterThan(vec3(plane), vec3(0.f)));
+    if (dot(vec3(plane), farthest) + plane.w < 0.f)
+      return false;
+  }
+  return true;
+}
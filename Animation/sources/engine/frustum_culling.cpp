@@ -0,0 +1,101 @@
+#include "frustum_culling.h"
+#include "job_system.h"
+#include <algorithm>
+#include <immintrin.h>
+
+void CullingBounds::resize(int size)
+{
+  if (size == count)
+    return;
+  int kept = std::min(count, size);
+  int newCapacity = (size + CullingLanes - 1) / CullingLanes * CullingLanes;
+  if (newCapacity != capacity)
+  {
+    //rows are strided by the capacity, so the kept boxes move to the new row starts
+    std::vector<float> oldRows = std::move(rows);
+    rows.assign(6 * newCapacity, 0.f);
+    for (int row = 0; row < 6; row++)
+      std::copy_n(oldRows.begin() + row * capacity, kept, rows.begin() + row * newCapacity);
+    capacity = newCapacity;
+  }
+  count = size;
+  //new boxes and padding lanes, including the ones left by a smaller count
+  for (int i = kept; i < capacity; i++)
+    set(i, BoundingBox());
+}
+
+void CullingBounds::set(int i, const BoundingBox &box)
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    rows[axis * capacity + i] = box.min[axis];
+    rows[(3 + axis) * capacity + i] = box.max[axis];
+  }
+}
+
+//writes visible indices of [begin, end) to visible starting from begin, returns their number
+static int cull_chunk(const CullingBounds &bounds, const Frustum &frustum, int begin, int end, uint32_t *visible)
+{
+  //the farthest corner along the plane normal takes max or min of every axis, so the choice
+  //is made once per plane and the lanes only multiply and add
+  const float *corners[6][3];
+  __m128 planes[6][4];
+  for (int p = 0; p < 6; p++)
+  {
+    const vec4 &plane = frustum.planes[p];
+    for (int axis = 0; axis < 3; axis++)
+    {
+      corners[p][axis] = &bounds.rows[((plane[axis] > 0.f ? 3 : 0) + axis) * bounds.capacity];
+      planes[p][axis] = _mm_set1_ps(plane[axis]);
+    }
+    planes[p][3] = _mm_set1_ps(plane.w);
+  }
+
+  int visibleCount = 0;
+  const __m128 zero = _mm_setzero_ps();
+  for (int lane = begin; lane < end; lane += CullingLanes)
+  {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++)
+    {
+      __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(planes[p][0], _mm_loadu_ps(corners[p][0] + lane)), _mm_mul_ps(planes[p][1], _mm_loadu_ps(corners[p][1] + lane))),
+        _mm_add_ps(_mm_mul_ps(planes[p][2], _mm_loadu_ps(corners[p][2] + lane)), planes[p][3]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+    }
+    for (int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1)
+      visible[visibleCount++] = lane + __builtin_ctz(mask);
+  }
+  return visibleCount;
+}
+
+void cull_bounds(const CullingBounds &bounds, const Frustum &frustum, std::vector<uint32_t> &visible)
+{
+  int chunkCount = (bounds.capacity + CullingChunkSize - 1) / CullingChunkSize;
+  visible.resize(bounds.capacity);
+  if (chunkCount <= 1)
+  {
+    visible.resize(cull_chunk(bounds, frustum, 0, bounds.capacity, visible.data()));
+    return;
+  }
+
+  //every chunk writes to its own range, then the ranges are packed in order
+  std::vector<int> chunkVisible(chunkCount);
+  parallel_for(chunkCount, 1, [&](int begin, int end)
+  {
+    for (int chunk = begin; chunk < end; chunk++)
+    {
+      int first = chunk * CullingChunkSize;
+      int last = std::min(first + CullingChunkSize, bounds.capacity);
+      chunkVisible[chunk] = cull_chunk(bounds, frustum, first, last, visible.data() + first);
+    }
+  });
+  int visibleCount = chunkVisible[0];
+  for (int chunk = 1; chunk < chunkCount; chunk++)
+  {
+    const uint32_t *chunkBegin = visible.data() + chunk * CullingChunkSize;
+    std::copy(chunkBegin, chunkBegin + chunkVisible[chunk], visible.data() + visibleCount);
+    visibleCount += chunkVisible[chunk];
+  }
+  visible.resize(visibleCount);
+}
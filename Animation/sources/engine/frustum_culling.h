@@ -0,0 +1,32 @@
+#pragma once
+#include "bounds.h"
+#include <cstdint>
+#include <vector>
+
+//boxes tested together in simd registers
+constexpr int CullingLanes = 4;
+//boxes per job, chunks are culled in parallel when there are more than one
+constexpr int CullingChunkSize = 1024;
+
+//boxes stored by coordinates, padding lanes are empty boxes which are never visible
+struct CullingBounds
+{
+  int count = 0;
+  //count padded to CullingLanes
+  int capacity = 0;
+  //min x, min y, min z, max x, max y, max z rows of capacity floats
+  std::vector<float> rows;
+
+  //keeps the first boxes up to the smaller count, new boxes are empty
+  void resize(int size);
+  //empty boxes are culled, use infinite_bounds for always visible objects
+  void set(int i, const BoundingBox &box);
+};
+
+inline BoundingBox infinite_bounds()
+{
+  return BoundingBox{vec3(-FLT_MAX), vec3(FLT_MAX)};
+}
+
+//indices of boxes intersecting the frustum in increasing order, the same test as is_visible
+void cull_bounds(const CullingBounds &bounds, const Frustum &frustum, std::vector<uint32_t> &visible);
@@ -0,0 +1,158 @@
+#include "job_system.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct QueuedJob
+{
+  Job job;
+  JobCounter *counter;
+};
+
+//owner works with the back, other threads steal from the front
+struct JobQueue
+{
+  std::mutex mutex;
+  std::deque<QueuedJob> jobs;
+};
+
+static std::vector<std::unique_ptr<JobQueue>> queues;
+static std::vector<std::thread> workers;
+static std::atomic<bool> running{false};
+static std::atomic<int> queuedJobs{0};
+static std::mutex sleepMutex;
+static std::condition_variable wakeCondition;
+static thread_local int threadIndex = 0;
+
+static bool pop_job(QueuedJob &result)
+{
+  int n = queues.size();
+  for (int i = 0; i < n; i++)
+  {
+    JobQueue &queue = *queues[(threadIndex + i) % n];
+    std::unique_lock lock(queue.mutex);
+    if (queue.jobs.empty())
+      continue;
+    if (i == 0)
+    {
+      result = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    }
+    else
+    {
+      result = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    queuedJobs--;
+    return true;
+  }
+  return false;
+}
+
+static void execute_job(QueuedJob &job)
+{
+  job.job();
+  if (job.counter)
+    job.counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+static void worker_loop(int index)
+{
+  threadIndex = index;
+  while (running)
+  {
+    QueuedJob job;
+    if (pop_job(job))
+    {
+      execute_job(job);
+      continue;
+    }
+    std::unique_lock lock(sleepMutex);
+    wakeCondition.wait(lock, []() { return !running || queuedJobs > 0; });
+  }
+}
+
+void init_job_system(int thread_count)
+{
+  if (thread_count <= 0)
+    thread_count = std::max((int)std::thread::hardware_concurrency(), 1);
+
+  for (int i = 0; i < thread_count; i++)
+    queues.emplace_back(std::make_unique<JobQueue>());
+
+  running = true;
+  threadIndex = 0;
+  for (int i = 1; i < thread_count; i++)
+    workers.emplace_back(worker_loop, i);
+}
+
+void close_job_system()
+{
+  {
+    std::unique_lock lock(sleepMutex);
+    running = false;
+  }
+  wakeCondition.notify_all();
+  for (std::thread &worker : workers)
+    worker.join();
+  workers.clear();
+  queues.clear();
+  queuedJobs = 0;
+}
+
+int get_job_thread_count()
+{
+  return std::max((int)queues.size(), 1);
+}
+
+void run_job(Job &&job, JobCounter *counter)
+{
+  if (counter)
+    counter->value.fetch_add(1, std::memory_order_relaxed);
+
+  if (queues.empty())
+  {
+    QueuedJob inplaceJob{std::move(job), counter};
+    execute_job(inplaceJob);
+    return;
+  }
+  {
+    JobQueue &queue = *queues[threadIndex];
+    std::unique_lock lock(queue.mutex);
+    queue.jobs.emplace_back(QueuedJob{std::move(job), counter});
+    queuedJobs++;
+  }
+  //sleeping worker checks queuedJobs under this mutex, so the notification can't be lost
+  {
+    std::unique_lock lock(sleepMutex);
+  }
+  wakeCondition.notify_one();
+}
+
+void wait_for_counter(const JobCounter &counter)
+{
+  while (counter.value.load(std::memory_order_acquire) > 0)
+  {
+    QueuedJob job;
+    if (pop_job(job))
+      execute_job(job);
+    else
+      std::this_thread::yield();
+  }
+}
+
+void parallel_for(int count, int grain_size, const std::function<void(int begin, int end)> &body)
+{
+  JobCounter counter;
+  grain_size = std::max(grain_size, 1);
+  for (int begin = 0; begin < count; begin += grain_size)
+  {
+    int end = std::min(begin + grain_size, count);
+    run_job([&body, begin, end]() { body(begin, end); }, &counter);
+  }
+  wait_for_counter(counter);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+#include <functional>
+
+struct JobCounter
+{
+  std::atomic<int> value{0};
+};
+
+using Job = std::function<void()>;
+
+//thread_count includes the main thread, 0 means all hardware threads
+void init_job_system(int thread_count = 0);
+void close_job_system();
+int get_job_thread_count();
+
+//counter is incremented now and decremented when the job is done
+void run_job(Job &&job, JobCounter *counter = nullptr);
+
+//executes queued jobs until the counter reaches zero
+void wait_for_counter(const JobCounter &counter);
+
+//splits [0, count) into jobs of grain_size elements and waits for all of them
+void parallel_for(int count, int grain_size, const std::function<void(int begin, int end)> &body);
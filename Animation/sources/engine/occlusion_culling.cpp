@@ -0,0 +1,187 @@
+#include "occlusion_culling.h"
+#include "job_system.h"
+#include <algorithm>
+#include <immintrin.h>
+
+constexpr int TileColumns = OcclusionWidth / OcclusionTileWidth;
+constexpr int TileRows = OcclusionHeight / OcclusionTileHeight;
+constexpr int BlockColumns = OcclusionWidth / OcclusionBlockSize;
+constexpr int BlockRows = OcclusionHeight / OcclusionBlockSize;
+static_assert(OcclusionTileWidth % 4 == 0 && OcclusionWidth % OcclusionTileWidth == 0 && OcclusionHeight % OcclusionTileHeight == 0);
+static_assert(OcclusionTileWidth % OcclusionBlockSize == 0 && OcclusionTileHeight % OcclusionBlockSize == 0);
+
+//nearer corners are treated as crossing the near plane
+static const float MinOcclusionW = 1e-3f;
+
+//faces of the box with corner bit 0 for x, 1 for y, 2 for z, front faces have negative area on the screen
+static const int BoxTriangles[12][3] = {
+  {0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6},
+  {0, 1, 5}, {0, 5, 4}, {2, 6, 7}, {2, 7, 3},
+  {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+
+void begin_occlusion_frame(OcclusionBuffer &buffer, const mat4 &view_projection)
+{
+  buffer.viewProjection = view_projection;
+  buffer.depth.assign(OcclusionWidth * OcclusionHeight, 1.f);
+  buffer.blockDepth.assign(BlockColumns * BlockRows, 1.f);
+  buffer.triangles.clear();
+  buffer.tileTriangles.resize(TileColumns * TileRows);
+  for (std::vector<uint32_t> &tile : buffer.tileTriangles)
+    tile.clear();
+  buffer.occluders = 0;
+}
+
+//false if any corner is behind the near plane
+static bool project_box(const mat4 &transform, const BoundingBox &box, vec3 *screen)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    vec3 corner = vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+    vec4 clip = transform * vec4(corner, 1.f);
+    if (clip.w < MinOcclusionW || clip.z < -clip.w)
+      return false;
+    vec3 ndc = vec3(clip) / clip.w;
+    screen[i] = vec3((ndc.x * 0.5f + 0.5f) * OcclusionWidth, (ndc.y * 0.5f + 0.5f) * OcclusionHeight, ndc.z * 0.5f + 0.5f);
+  }
+  return true;
+}
+
+//pixels under [lo, hi] clamped to the screen, the floats may be far out of the int range
+static ivec4 screen_rect(vec2 lo, vec2 hi)
+{
+  const vec2 size = vec2(OcclusionWidth - 1, OcclusionHeight - 1);
+  ivec2 a = ivec2(glm::clamp(lo, vec2(0.f), size));
+  ivec2 b = ivec2(glm::clamp(hi, vec2(0.f), size));
+  return ivec4(a, b);
+}
+
+void add_occluder(OcclusionBuffer &buffer, const mat4 &transform, const BoundingBox &box)
+{
+  vec3 screen[8];
+  mat4 m = buffer.viewProjection * transform;
+  if (!project_box(m, box, screen))
+    return;
+  //mirroring transforms turn the winding over
+  bool mirrored = determinant(mat3(transform)) < 0.f;
+  bool added = false;
+  for (const int *triangle : BoxTriangles)
+  {
+    OcclusionTriangle t = {{screen[triangle[0]], screen[triangle[1]], screen[triangle[2]]}};
+    float area = (t.v[1].x - t.v[0].x) * (t.v[2].y - t.v[0].y) - (t.v[2].x - t.v[0].x) * (t.v[1].y - t.v[0].y);
+    //back faces are hidden by front ones of the same box
+    if ((area >= 0.f) != mirrored || area == 0.f)
+      continue;
+    vec2 lo = glm::min(glm::min(vec2(t.v[0]), vec2(t.v[1])), vec2(t.v[2]));
+    vec2 hi = glm::max(glm::max(vec2(t.v[0]), vec2(t.v[1])), vec2(t.v[2]));
+    if (hi.x < 0.f || hi.y < 0.f || lo.x >= OcclusionWidth || lo.y >= OcclusionHeight)
+      continue;
+    ivec4 rect = screen_rect(lo, hi);
+    int x0 = rect.x / OcclusionTileWidth, y0 = rect.y / OcclusionTileHeight;
+    int x1 = rect.z / OcclusionTileWidth, y1 = rect.w / OcclusionTileHeight;
+    uint32_t index = buffer.triangles.size();
+    buffer.triangles.push_back(t);
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++)
+        buffer.tileTriangles[y * TileColumns + x].push_back(index);
+    added = true;
+  }
+  buffer.occluders += added;
+}
+
+//edge functions are evaluated for 4 pixel centers of a row at once
+static void rasterize_tile(OcclusionBuffer &buffer, int tile)
+{
+  int tileX = tile % TileColumns * OcclusionTileWidth;
+  int tileY = tile / TileColumns * OcclusionTileHeight;
+  const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  for (uint32_t index : buffer.tileTriangles[tile])
+  {
+    const OcclusionTriangle &t = buffer.triangles[index];
+    const vec3 &a = t.v[0], &b = t.v[1], &c = t.v[2];
+    float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    //edges are positive inside for both windings
+    float sign = area > 0.f ? 1.f : -1.f;
+    vec3 edges[3];
+    const vec3 *v[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++)
+    {
+      const vec3 &p = *v[(i + 1) % 3], &q = *v[(i + 2) % 3];
+      edges[i] = sign * vec3(p.y - q.y, q.x - p.x, p.x * q.y - p.y * q.x);
+    }
+    //depth is affine in screen space after the perspective divide
+    float invArea = 1.f / area;
+    float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) * invArea;
+    float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) * invArea;
+    float z0 = a.z - dzdx * a.x - dzdy * a.y;
+
+    ivec4 rect = screen_rect(glm::min(glm::min(vec2(a), vec2(b)), vec2(c)), glm::max(glm::max(vec2(a), vec2(b)), vec2(c)));
+    int x0 = std::max(rect.x, tileX) & ~3;
+    int x1 = std::min(rect.z, tileX + OcclusionTileWidth - 1);
+    int y0 = std::max(rect.y, tileY);
+    int y1 = std::min(rect.w, tileY + OcclusionTileHeight - 1);
+    __m128 ex[3], zx = _mm_set1_ps(dzdx);
+    for (int i = 0; i < 3; i++)
+      ex[i] = _mm_set1_ps(edges[i].x);
+    for (int y = y0; y <= y1; y++)
+    {
+      float py = y + 0.5f;
+      float *row = &buffer.depth[y * OcclusionWidth];
+      for (int x = x0; x <= x1; x += 4)
+      {
+        __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[0], px), _mm_set1_ps(edges[0].y * py + edges[0].z)), zero);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[1], px), _mm_set1_ps(edges[1].y * py + edges[1].z)), zero));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[2], px), _mm_set1_ps(edges[2].y * py + edges[2].z)), zero));
+        if (_mm_movemask_ps(inside) == 0)
+          continue;
+        __m128 z = _mm_add_ps(_mm_mul_ps(zx, px), _mm_set1_ps(dzdy * py + z0));
+        __m128 depth = _mm_loadu_ps(row + x);
+        __m128 nearer = _mm_min_ps(depth, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+      }
+    }
+  }
+
+  for (int by = tileY / OcclusionBlockSize; by < (tileY + OcclusionTileHeight) / OcclusionBlockSize; by++)
+    for (int bx = tileX / OcclusionBlockSize; bx < (tileX + OcclusionTileWidth) / OcclusionBlockSize; bx++)
+    {
+      __m128 farthest = zero;
+      for (int y = by * OcclusionBlockSize; y < (by + 1) * OcclusionBlockSize; y++)
+        for (int x = bx * OcclusionBlockSize; x < (bx + 1) * OcclusionBlockSize; x += 4)
+          farthest = _mm_max_ps(farthest, _mm_loadu_ps(&buffer.depth[y * OcclusionWidth + x]));
+      farthest = _mm_max_ps(farthest, _mm_movehl_ps(farthest, farthest));
+      farthest = _mm_max_ss(farthest, _mm_shuffle_ps(farthest, farthest, 1));
+      buffer.blockDepth[by * BlockColumns + bx] = _mm_cvtss_f32(farthest);
+    }
+}
+
+void rasterize_occluders(OcclusionBuffer &buffer)
+{
+  parallel_for(TileColumns * TileRows, 1, [&](int begin, int end)
+  {
+    for (int tile = begin; tile < end; tile++)
+      rasterize_tile(buffer, tile);
+  });
+}
+
+bool is_occluded(const OcclusionBuffer &buffer, const BoundingBox &box)
+{
+  vec3 screen[8];
+  if (box.empty() || !project_box(buffer.viewProjection, box, screen))
+    return false;
+  vec3 lo = screen[0], hi = screen[0];
+  for (int i = 1; i < 8; i++)
+  {
+    lo = glm::min(lo, screen[i]);
+    hi = glm::max(hi, screen[i]);
+  }
+  if (hi.x < 0.f || hi.y < 0.f || lo.x >= OcclusionWidth || lo.y >= OcclusionHeight)
+    return false;
+  ivec4 rect = screen_rect(lo, hi) / OcclusionBlockSize;
+  for (int y = rect.y; y <= rect.w; y++)
+    for (int x = rect.x; x <= rect.z; x++)
+      if (buffer.blockDepth[y * BlockColumns + x] >= lo.z)
+        return false;
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "bounds.h"
+#include <cstdint>
+#include <vector>
+
+//small depth buffer, the width is a multiple of the simd width
+constexpr int OcclusionWidth = 256;
+constexpr int OcclusionHeight = 128;
+//tiles are rasterized in parallel
+constexpr int OcclusionTileWidth = 64;
+constexpr int OcclusionTileHeight = 32;
+//max depth of blocks is the coarse level tested by bounds
+constexpr int OcclusionBlockSize = 8;
+
+//screen space vertices, z is the depth in [0, 1]
+struct OcclusionTriangle
+{
+  vec3 v[3];
+};
+
+struct OcclusionBuffer
+{
+  mat4 viewProjection;
+  std::vector<float> depth;
+  std::vector<float> blockDepth;
+  std::vector<OcclusionTriangle> triangles;
+  //triangles overlapping every tile
+  std::vector<std::vector<uint32_t>> tileTriangles;
+  int occluders = 0;
+};
+
+//clears the depth to the far plane, occluders and bounds are projected with view_projection
+void begin_occlusion_frame(OcclusionBuffer &buffer, const mat4 &view_projection);
+
+//oriented box, box is in the space of transform, boxes crossing the near plane are skipped,
+//occluders must be inside the geometry they stand for
+void add_occluder(OcclusionBuffer &buffer, const mat4 &transform, const BoundingBox &box);
+
+//depth of the triangles in parallel tiles and the block level
+void rasterize_occluders(OcclusionBuffer &buffer);
+
+//true if every block under the screen rect of the box is nearer than the nearest corner,
+//boxes crossing the near plane or out of the screen are never occluded
+bool is_occluded(const OcclusionBuffer &buffer, const BoundingBox &box);
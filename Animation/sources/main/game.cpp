@@ -2,8 +2,29 @@
 #include <render/direction_light.h>
 #include <render/material.h>
 #include <render/mesh.h>
+#include <render/morph_targets.h>
+#include <render/global_render_data.h>
+#include <render/render_queue.h>
+#include <render/gl_state.h>
+#include <render/geometry_pool.h>
+#include <anim/animated_model.h>
+#include <anim/animation_player.h>
+#include <anim/ik.h>
+#include <anim/pose_cache.h>
+#include <anim/joint_query.h>
+#include <anim/spring_bones.h>
+#include <anim/root_motion.h>
+#include <anim/motion_matching.h>
 #include "camera.h"
 #include <application.h>
+#include <job_system.h>
+#include <frustum_culling.h>
+#include <occlusion_culling.h>
+#include <imgui/imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
 
 struct UserCamera
 {
@@ -17,6 +38,44 @@ struct Character
   glm::mat4 transform;
   MeshPtr mesh;
   MaterialPtr material;
+  AnimationPlayer animation;
+  float nextTransitionTime;
+  int transitionCount;
+  //pose was evaluated this frame
+  bool evaluated;
+  //offsets of the mesh morph targets, unused if the mesh doesn't have them
+  MorphState morph = {};
+  JointBoundsPtr jointBounds = nullptr;
+  //world space bounds of the skinned mesh after the last evaluation
+  BoundingBox bounds = {};
+  SkinnedRaycastModelPtr raycastModel = nullptr;
+  //refitted lazily by raycasts
+  SkinnedRaycastState raycast = {};
+  //single joint queries of gameplay for culled and lod characters
+  JointQueryCache jointQueries = {};
+};
+
+struct AnimationStats
+{
+  std::atomic<int> evaluatedCharacters = 0;
+  //in the frustum but hidden by occluders
+  std::atomic<int> occludedCharacters = 0;
+  std::atomic<int> evaluatedJoints = 0;
+  //joints sampled by masked layers
+  std::atomic<int> layerJoints = 0;
+  std::atomic<int> sampledClips = 0;
+  //clips which would be sampled if every transition was a crossfade
+  std::atomic<int> crossfadeSampledClips = 0;
+  //characters which reused a pose from the pose cache
+  std::atomic<int> cachedPoses = 0;
+};
+
+enum class FootIk
+{
+  Off,
+  TwoBone,
+  Ccd,
+  Fabrik
 };
 
 struct Scene
@@ -26,11 +85,159 @@ struct Scene
   UserCamera userCamera;
 
   std::vector<Character> characters;
+  std::vector<AnimationClipPtr> animations;
+
+  AnimationTransition transition = AnimationTransition::Inertialization;
+  float transitionDuration = 0.3f;
+  float transitionPeriod = 3.f;
+  //upper body override and additive layers of every character
+  std::vector<float> layerWeights;
+
+  //characters in the same animation state share one evaluation
+  bool usePoseCache = true;
+  PoseCache poseCache;
+
+  //characters walk with the extracted root motion, otherwise they animate in place
+  bool rootMotion = false;
+
+  //view angle error allowed for skeleton lods
+  float skeletonLodTolerance = 0.004f;
+
+  AnimationStats animationStats;
+  //thread count and ms per animation update
+  std::vector<vec2> threadsBenchmark;
+
+  MotionDatabasePtr motionDatabase;
+  //microseconds per query, brute force and bounding box hierarchy
+  vec2 motionMatchingBenchmark = vec2(0.f);
+
+  //keeps feet above the ground, both legs of all evaluated characters are solved in one batch
+  FootIk footIk = FootIk::Off;
+  float groundHeight = 0.f;
+  IkChain legChains[2];
+  int hipsJoint = -1;
+  IkBatch footIkBatch;
+  std::vector<int> footIkCharacters;
+  float footIkMs = 0.f;
+
+  //secondary motion of fingers, colliding with legs and spine
+  bool useSpringBones = false;
+  SpringBoneSystemPtr springBones;
+  float springBonesMs = 0.f;
 
+  //morph target weights are animated procedurally, targets below the epsilon are skipped
+  float morphEpsilon = 1e-3f;
+  float morphTime = 0.f;
+  int morphTouchedVertices = 0;
+  int morphVertices = 0;
+  float morphMs = 0.f;
+
+  //skinned bounds are used for lod distances and to cull draws
+  float skinnedBoundsMs = 0.f;
+  //bounds of all characters for the render culling, characters which weren't evaluated are empty
+  CullingBounds characterBounds;
+  std::vector<uint32_t> visibleCharacters;
+  float cullingMs = 0.f;
+
+  //characters are tested against the joint occluders of the last frame before the animation
+  bool useOcclusionCulling = true;
+  OcclusionBuffer occlusion;
+  float occlusionMs = 0.f;
+
+  //draws of the frame sorted by state
+  RenderQueue renderQueue;
+
+  //poses change every update, raycasts refit the character bvh once per frame
+  int frameIndex = 0;
+  //right click picks a character
+  int pickedCharacter = -1;
+  float pickedDistance = 0.f;
+  //rays per second of the bvh and brute force, capsule rejected fraction
+  vec3 raycastBenchmark = vec3(0.f);
+
+  //the camera looks at the head of the picked character
+  bool followPicked = false;
+  //debug, follows character 0 without picking, so the lazy query runs when it's culled
+  bool followFirst = false;
+  //the followed head came from query_joint_transform instead of the evaluated pose
+  bool headQueried = false;
+  int headJoint = -1;
+  //us per query of the head with lazy chains and with full evaluation
+  vec2 jointQueryBenchmark = vec2(0.f);
 };
 
+//characters per animation job
+constexpr int AnimationJobGrain = 4;
+
 static std::unique_ptr<Scene> scene;
 
+constexpr int CrowdSize = 10;
+constexpr float CameraFarPlane = 500.f;
+
+static mat4 crowd_transform(int i)
+{
+  const float crowdSpacing = 1.5f;
+  vec3 position = vec3(i % CrowdSize - CrowdSize / 2, 0, i / CrowdSize) * crowdSpacing;
+  return glm::translate(glm::mat4(1.f), position);
+}
+
+//evaluated pose if it has the joint, otherwise only the chain to the joint is evaluated
+static mat4 character_joint_transform(Character &character, int joint)
+{
+  const AnimationPlayer &animation = character.animation;
+  if (character.evaluated && joint < animation.skeleton->lodJointCount[animation.lod])
+  {
+    const std::vector<mat4> &modelPose = animation.sharedPose ? animation.sharedPose->modelPose : animation.modelPose;
+    return character.transform * modelPose[joint];
+  }
+  return character.transform * query_joint_transform(animation, character.jointQueries, joint, scene->frameIndex);
+}
+
+//world space ray, false if the pose of the character wasn't evaluated this frame or it's missed
+static bool raycast_character(Character &character, const vec3 &origin, const vec3 &direction, float &distance)
+{
+  if (!character.evaluated || !character.raycastModel || character.bounds.empty())
+    return false;
+  float boxDistance, boxExit;
+  if (!ray_box_intersection(character.bounds, origin, 1.f / direction, distance, boxDistance, boxExit))
+    return false;
+
+  //the palette is in the model space of the character
+  mat4 toModel = inverse(character.transform);
+  vec3 modelOrigin = vec3(toModel * vec4(origin, 1.f));
+  vec3 modelDirection = vec3(toModel * vec4(direction, 0.f));
+  const mat4 *palette = animation_palette(character.animation).data();
+  const SkinnedRaycastModel &model = *character.raycastModel;
+  //the ray parameter is the same in the model space, the capsules can't be hit past the bounds
+  if (!raycast_joint_capsules(model, palette, modelOrigin, modelDirection, boxExit))
+    return false;
+  refit_skinned_bvh(model, palette, scene->frameIndex, character.raycast);
+  RayHit hit;
+  hit.distance = distance;
+  if (!raycast_skinned_mesh(model, character.raycast, modelOrigin, modelDirection, hit))
+    return false;
+  distance = hit.distance;
+  return true;
+}
+
+static void pick_character(int x, int y)
+{
+  const ImVec2 &size = ImGui::GetIO().DisplaySize;
+  vec2 ndc = vec2(2.f * x / size.x - 1.f, 1.f - 2.f * y / size.y);
+  mat4 toWorld = inverse(scene->userCamera.projection * inverse(scene->userCamera.transform));
+  vec4 nearPoint = toWorld * vec4(ndc, -1.f, 1.f);
+  vec4 farPoint = toWorld * vec4(ndc, 1.f, 1.f);
+  vec3 origin = vec3(nearPoint) / nearPoint.w;
+  vec3 direction = normalize(vec3(farPoint) / farPoint.w - origin);
+
+  scene->pickedCharacter = -1;
+  float distance = FLT_MAX;
+  for (int i = 0, n = scene->characters.size(); i < n; i++)
+    if (raycast_character(scene->characters[i], origin, direction, distance))
+      scene->pickedCharacter = i;
+  scene->pickedDistance = distance;
+}
+
 void game_init()
 {
   scene = std::make_unique<Scene>();
@@ -38,7 +245,7 @@ void game_init()
   scene->light.lightColor = glm::vec3(1.f);
   scene->light.ambient = glm::vec3(0.2f);
 
-  scene->userCamera.projection = glm::perspective(90.f * DegToRad, get_aspect_ratio(), 0.01f, 500.f);
+  scene->userCamera.projection = glm::perspective(90.f * DegToRad, get_aspect_ratio(), 0.01f, CameraFarPlane);
 
   ArcballCamera &cam = scene->userCamera.arcballCamera;
   cam.curZoom = cam.targetZoom = 0.5f;
@@ -54,6 +261,11 @@ void game_init()
   scene->userCamera.transform = calculate_transform(scene->userCamera.arcballCamera);
 
   input.onMouseButtonEvent += [](const SDL_MouseButtonEvent &e) { arccam_mouse_click_handler(e, scene->userCamera.arcballCamera); };
+  input.onMouseButtonEvent += [](const SDL_MouseButtonEvent &e)
+  {
+    if (e.button == SDL_BUTTON_RIGHT && e.type == SDL_MOUSEBUTTONDOWN && !ImGui::GetIO().WantCaptureMouse)
+      pick_character(e.x, e.y);
+  };
   input.onMouseMotionEvent += [](const SDL_MouseMotionEvent &e) { arccam_mouse_move_handler(e, scene->userCamera.arcballCamera); };
   input.onMouseWheelEvent += [](const SDL_MouseWheelEvent &e) { arccam_mouse_wheel_handler(e, scene->userCamera.arcballCamera); };
 
@@ -61,45 +273,648 @@ void game_init()
   auto material = make_material("character", "sources/shaders/character_vs.glsl", "sources/shaders/character_ps.glsl");
   std::fflush(stdout);
   material->set_property("mainTex", create_texture2d("resources/MotusMan_v55/MCG_diff.jpg"));
+  material->set_property("Shininess", 1.3f);
+  material->set_property("Metallness", 0.4f);
 
-  scene->characters.emplace_back(Character{
-    glm::identity<glm::mat4>(),
-    load_mesh("resources/MotusMan_v55/MotusMan_v55.fbx", 0),
-    std::move(material)
-  });
+  AnimatedModelPtr model = load_animated_model("resources/MotusMan_v55/MotusMan_v55.fbx", 0);
+  if (!model)
+    return;
+
+  for (int i = 0; i < CrowdSize * CrowdSize; i++)
+  {
+    Character &character = scene->characters.emplace_back(Character{
+      crowd_transform(i),
+      model->mesh,
+      material,
+      {},
+      i * 0.13f,
+      i,
+      false
+    });
+    init_animation_player(character.animation, model->skeleton);
+    character.jointBounds = model->jointBounds;
+    character.raycastModel = model->raycastModel;
+    if (model->mesh->morphTargets)
+      init_morph_state(character.morph, *model->mesh->morphTargets);
+    if (!model->animations.empty())
+    {
+      play_animation(character.animation, model->animations[0]);
+      advance_animation_player(character.animation, i * 0.37f);
+    }
+  }
+  if (model->animations.size() >= 2)
+  {
+    BoneMaskPtr upperBody = make_bone_mask(*model->skeleton, {"Spine1"});
+    const AnimationClip &additiveSource = *model->animations.back();
+    AnimationClipPtr additive = make_additive_clip(additiveSource, sample_reference_pose(additiveSource, 0.f));
+    for (Character &character : scene->characters)
+    {
+      add_animation_layer(character.animation, model->animations[1], upperBody, 0.f);
+      add_animation_layer(character.animation, additive, upperBody, 0.f);
+    }
+    scene->layerWeights.assign(2, 0.f);
+  }
+  scene->animations = model->animations;
+  scene->motionDatabase = build_motion_database(*model->skeleton, model->animations);
+  scene->legChains[0] = make_ik_chain(*model->skeleton, "LeftUpLeg", "LeftFoot");
+  scene->legChains[1] = make_ik_chain(*model->skeleton, "RightUpLeg", "RightFoot");
+  scene->hipsJoint = model->skeleton->find_joint("Hips");
+  scene->headJoint = model->skeleton->find_joint("Head");
+
+  const Skeleton &skeleton = *model->skeleton;
+  SpringBoneSettings springSettings;
+  springSettings.chainRoots = {"LeftHandIndex1", "RightHandIndex1", "LeftHandPinky1", "RightHandPinky1"};
+  std::vector<SpringCollider> springColliders = {
+    make_spring_collider(skeleton, "LeftUpLeg", "LeftLeg", 0.08f),
+    make_spring_collider(skeleton, "RightUpLeg", "RightLeg", 0.08f),
+    make_spring_collider(skeleton, "Spine", "Spine2", 0.14f)};
+  scene->springBones = make_spring_bone_system(skeleton, springSettings, springColliders, scene->characters.size());
   std::fflush(stdout);
 }
 
 
+struct AnimationJobStats
+{
+  int characters = 0;
+  int occluded = 0;
+  int joints = 0;
+  int layerJoints = 0;
+  int sampledClips = 0;
+  int crossfadeSampledClips = 0;
+  int cachedPoses = 0;
+};
+
+//switches clips periodically, every character has own phase
+static void update_character_transitions(Character &character)
+{
+  const std::vector<AnimationClipPtr> &animations = scene->animations;
+  if (animations.empty() || get_time() < character.nextTransitionTime)
+    return;
+  character.nextTransitionTime += scene->transitionPeriod;
+  character.transitionCount++;
+  const AnimationClipPtr &clip = animations[character.transitionCount % animations.size()];
+  play_animation(character.animation, clip, scene->transitionDuration, scene->transition);
+}
+
+//sampling, blending, hierarchy and palette for one character
+static void update_character_animation(Character &character, const Frustum &frustum, vec3 camera_position, float dt, AnimationJobStats &stats)
+{
+  AnimationPlayer &animation = character.animation;
+  character.evaluated = false;
+  update_character_transitions(character);
+  advance_animation_player(animation, dt);
+  if (scene->rootMotion)
+    character.transform = character.transform * root_motion_transform(animation.rootMotion);
+
+  //invisible characters keep only the clock and evaluate the pose when they are in view again
+  BoundingBox bounds = animation_bounds(animation);
+  if (!bounds.empty())
+  {
+    bounds = transform_bounds(character.transform, bounds);
+    bool visible = is_visible(frustum, bounds);
+    bool occluded = visible && scene->useOcclusionCulling && is_occluded(scene->occlusion, bounds);
+    if (!visible || occluded)
+    {
+      stats.occluded += occluded;
+      //the shared pose lives only until the next frame
+      detach_shared_pose(animation);
+      return;
+    }
+  }
+
+  //nearest point of the last skinned bounds, the root can be far from the mesh in some clips
+  vec3 position = vec3(character.transform[3]);
+  if (!character.bounds.empty())
+    position = glm::clamp(camera_position, character.bounds.min, character.bounds.max);
+  float distance = length(position - camera_position);
+  animation.lod = select_skeleton_lod(*animation.skeleton, distance, scene->skeletonLodTolerance);
+  int jointCount = animation.skeleton->lodJointCount[animation.lod];
+  for (int i = 0, n = animation.layers.size(); i < n; i++)
+  {
+    AnimationLayer &layer = animation.layers[i];
+    layer.weight = scene->layerWeights[i];
+    if (layer.weight > 0.f)
+      stats.layerJoints += count_masked_joints(*layer.mask, jointCount);
+  }
+  bool shared = false;
+  if (scene->usePoseCache)
+    shared = evaluate_cached_animation_player(scene->poseCache, animation);
+  else
+    evaluate_animation_player(animation);
+  character.evaluated = true;
+
+  stats.characters++;
+  if (shared)
+  {
+    stats.cachedPoses++;
+  }
+  else
+  {
+    stats.joints += jointCount;
+    stats.sampledClips += animation.prevClip ? 2 : 1;
+    stats.crossfadeSampledClips += is_in_transition(animation) ? 2 : 1;
+  }
+}
+
+static void update_foot_ik()
+{
+  const IkChain *chains = scene->legChains;
+  if (scene->footIk == FootIk::Off || chains[0].joints.empty() || chains[1].joints.empty() || scene->hipsJoint < 0)
+    return;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<int> &characters = scene->footIkCharacters;
+  characters.clear();
+  for (int i = 0, n = scene->characters.size(); i < n; i++)
+    if (scene->characters[i].evaluated)
+      characters.push_back(i);
+
+  IkBatch &batch = scene->footIkBatch;
+  batch.resize(3, characters.size() * 2);
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      AnimationPlayer &animation = scene->characters[characters[i]].animation;
+      detach_shared_pose(animation);
+      const std::vector<mat4> &model = animation.modelPose;
+      vec3 forward = vec3(model[scene->hipsJoint][2]);
+      for (int leg = 0; leg < 2; leg++)
+      {
+        vec3 positions[3];
+        for (int j = 0; j < 3; j++)
+          positions[j] = vec3(model[chains[leg].joints[j]][3]);
+        vec3 target = vec3(positions[2].x, glm::max(positions[2].y, scene->groundHeight), positions[2].z);
+        //knee keeps its bend direction, straight legs bend forward
+        vec3 pole = positions[1] + (positions[1] - (positions[0] + positions[2]) * 0.5f) + forward * 0.1f;
+        batch.set_chain(i * 2 + leg, positions, target, pole);
+      }
+    }
+  });
+
+  switch (scene->footIk)
+  {
+  case FootIk::TwoBone: solve_two_bone_ik(batch); break;
+  case FootIk::Ccd: solve_ccd_ik(batch, 10, 1e-3f); break;
+  case FootIk::Fabrik: solve_fabrik_ik(batch, 10, 1e-3f); break;
+  default: break;
+  }
+
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      AnimationPlayer &animation = scene->characters[characters[i]].animation;
+      const Skeleton &skeleton = *animation.skeleton;
+      int jointCount = skeleton.lodJointCount[animation.lod];
+      for (int leg = 0; leg < 2; leg++)
+      {
+        vec3 positions[3];
+        batch.get_chain(i * 2 + leg, positions);
+        apply_ik_chain(skeleton, chains[leg], positions, jointCount, animation.pose, animation.modelPose.data());
+      }
+      model_to_palette(skeleton, animation.modelPose.data(), jointCount, animation.palette.data());
+    }
+  });
+
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->footIkMs = time.count();
+}
+
+static void update_spring_bones(float dt)
+{
+  SpringBoneSystem &system = *scene->springBones;
+  if (!scene->useSpringBones || system.chains.empty())
+    return;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<Character> &characters = scene->characters;
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+      if (characters[i].evaluated)
+      {
+        AnimationPlayer &animation = characters[i].animation;
+        detach_shared_pose(animation);
+        int jointCount = animation.skeleton->lodJointCount[animation.lod];
+        set_spring_bone_character(system, i, characters[i].transform, animation.modelPose.data(), jointCount);
+      }
+      else
+      {
+        //culled characters moved without simulation, stale particles would whip when they reappear
+        reset_spring_bone_character(system, i);
+      }
+  });
+
+  simulate_spring_bones(system, dt);
+
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+      if (characters[i].evaluated)
+      {
+        AnimationPlayer &animation = characters[i].animation;
+        const Skeleton &skeleton = *animation.skeleton;
+        int jointCount = skeleton.lodJointCount[animation.lod];
+        apply_spring_bones(system, i, skeleton, characters[i].transform, jointCount, animation.pose, animation.modelPose.data());
+        model_to_palette(skeleton, animation.modelPose.data(), jointCount, animation.palette.data());
+      }
+  });
+
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->springBonesMs = time.count();
+}
+
+static void update_morph_targets(float dt)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  scene->morphTime += dt;
+  std::atomic<int> touched = 0, vertices = 0;
+  std::vector<Character> &characters = scene->characters;
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    std::vector<float> weights;
+    for (int i = begin; i < end; i++)
+    {
+      const MorphTargetSetPtr &morphTargets = characters[i].mesh->morphTargets;
+      if (!morphTargets || !characters[i].evaluated)
+        continue;
+      //every target pulses with its own period, so most of the time only a few of them are active
+      weights.resize(morphTargets->targets.size());
+      for (int j = 0, n = weights.size(); j < n; j++)
+        weights[j] = glm::max(sinf(scene->morphTime * (1.f + 0.3f * j) + i), 0.f);
+      touched += accumulate_morph_targets(*morphTargets, weights.data(), scene->morphEpsilon, characters[i].morph);
+      vertices += morphTargets->vertexCount;
+    }
+  });
+  for (Character &character : characters)
+    if (character.mesh->morphTargets && character.evaluated)
+      upload_morph_state(character.morph);
+  scene->morphTouchedVertices = touched;
+  scene->morphVertices = vertices;
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->morphMs = time.count();
+}
+
+static void update_skinned_bounds()
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<Character> &characters = scene->characters;
+  CullingBounds &cullingBounds = scene->characterBounds;
+  cullingBounds.resize(characters.size());
+  parallel_for(characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    for (int i = begin; i < end; i++)
+    {
+      Character &character = characters[i];
+      if (character.evaluated && character.jointBounds)
+        character.bounds = skinned_bounds(*character.jointBounds, character.transform, animation_palette(character.animation).data());
+      //characters without joint bounds are never culled
+      if (!character.evaluated)
+        cullingBounds.set(i, BoundingBox());
+      else
+        cullingBounds.set(i, character.bounds.empty() ? infinite_bounds() : character.bounds);
+    }
+  });
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->skinnedBoundsMs = time.count();
+}
+
+//occluders of characters evaluated in the last frame with their last poses, the shared poses are
+//still alive before the pose cache frame begins
+static void update_occlusion(const mat4 &view_projection)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  OcclusionBuffer &occlusion = scene->occlusion;
+  begin_occlusion_frame(occlusion, view_projection);
+  for (const Character &character : scene->characters)
+    if (character.evaluated && character.jointBounds)
+      add_skinned_occluders(occlusion, *character.jointBounds, character.transform, animation_palette(character.animation).data());
+  rasterize_occluders(occlusion);
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->occlusionMs = time.count();
+}
+
 void game_update()
 {
+  scene->frameIndex++;
   arcball_camera_update(
     scene->userCamera.arcballCamera,
     scene->userCamera.transform,
     get_delta_time());
+
+  const glm::mat4 &cameraTransform = scene->userCamera.transform;
+  vec3 cameraPosition = vec3(cameraTransform[3]);
+  mat4 viewProjection = scene->userCamera.projection * inverse(cameraTransform);
+  Frustum frustum = extract_frustum(viewProjection);
+  float dt = get_delta_time();
+  if (scene->useOcclusionCulling)
+    update_occlusion(viewProjection);
+
+  AnimationStats &stats = scene->animationStats;
+  stats.evaluatedCharacters = 0;
+  stats.occludedCharacters = 0;
+  stats.evaluatedJoints = 0;
+  stats.layerJoints = 0;
+  stats.sampledClips = 0;
+  stats.crossfadeSampledClips = 0;
+  stats.cachedPoses = 0;
+  begin_pose_cache_frame(scene->poseCache);
+  parallel_for(scene->characters.size(), AnimationJobGrain, [&](int begin, int end)
+  {
+    AnimationJobStats jobStats;
+    for (int i = begin; i < end; i++)
+      update_character_animation(scene->characters[i], frustum, cameraPosition, dt, jobStats);
+    stats.evaluatedCharacters += jobStats.characters;
+    stats.occludedCharacters += jobStats.occluded;
+    stats.evaluatedJoints += jobStats.joints;
+    stats.layerJoints += jobStats.layerJoints;
+    stats.sampledClips += jobStats.sampledClips;
+    stats.crossfadeSampledClips += jobStats.crossfadeSampledClips;
+    stats.cachedPoses += jobStats.cachedPoses;
+  });
+  update_foot_ik();
+  if (scene->springBones)
+    update_spring_bones(dt);
+  update_morph_targets(dt);
+  update_skinned_bounds();
+
+  int followed = scene->followFirst ? 0 : scene->pickedCharacter;
+  scene->headQueried = false;
+  if (scene->followPicked && followed >= 0 && followed < (int)scene->characters.size() && scene->headJoint >= 0)
+  {
+    Character &character = scene->characters[followed];
+    const AnimationPlayer &animation = character.animation;
+    scene->headQueried = !character.evaluated || scene->headJoint >= animation.skeleton->lodJointCount[animation.lod];
+    scene->userCamera.arcballCamera.targetPosition = vec3(character_joint_transform(character, scene->headJoint)[3]);
+  }
+}
+
+static void run_threads_benchmark()
+{
+  const int iterations = 20;
+  int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+  int savedThreads = get_job_thread_count();
+  std::vector<vec2> &results = scene->threadsBenchmark;
+  results.clear();
+  for (int threads = 1; threads <= maxThreads; threads++)
+  {
+    close_job_system();
+    init_job_system(threads);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+      parallel_for(scene->characters.size(), AnimationJobGrain, [](int begin, int end)
+      {
+        for (int j = begin; j < end; j++)
+          evaluate_animation_player(scene->characters[j].animation);
+      });
+    std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+    float ms = time.count() / iterations;
+    results.emplace_back(threads, ms);
+    debug_log("animation update, %d threads: %.3f ms, x%.2f", threads, ms, results[0].y / ms);
+  }
+  close_job_system();
+  init_job_system(savedThreads);
+}
+
+//queries are database rows with noise, both searches must find the same cost
+static void run_motion_matching_benchmark()
+{
+  const MotionDatabase &database = *scene->motionDatabase;
+  const int queryCount = 1000;
+  std::mt19937 random(0);
+  std::normal_distribution<float> noise(0.f, 0.3f);
+  std::vector<float> queries(queryCount * MotionFeatureStride, 0.f);
+  for (int i = 0; i < queryCount; i++)
+  {
+    const float *row = &database.features[(random() % database.rowCount) * MotionFeatureStride];
+    for (int j = 0; j < MotionFeatureCount; j++)
+      queries[i * MotionFeatureStride + j] = row[j] + noise(random);
+  }
+
+  std::vector<MotionMatch> bruteForce(queryCount), hierarchy(queryCount);
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < queryCount; i++)
+    bruteForce[i] = search_motion_database_brute_force(database, &queries[i * MotionFeatureStride]);
+  auto middle = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < queryCount; i++)
+    hierarchy[i] = search_motion_database(database, &queries[i * MotionFeatureStride]);
+  auto end = std::chrono::high_resolution_clock::now();
+
+  int mismatches = 0;
+  for (int i = 0; i < queryCount; i++)
+    mismatches += glm::abs(bruteForce[i].cost - hierarchy[i].cost) > 1e-3f * glm::max(bruteForce[i].cost, 1.f);
+
+  std::chrono::duration<float, std::micro> bruteForceTime = middle - start, hierarchyTime = end - middle;
+  scene->motionMatchingBenchmark = vec2(bruteForceTime.count(), hierarchyTime.count()) / float(queryCount);
+  debug_log("motion matching, %d frames: brute force %.2f us, hierarchy %.2f us per query, %d mismatches",
+    database.rowCount, scene->motionMatchingBenchmark.x, scene->motionMatchingBenchmark.y, mismatches);
 }
 
-void render_character(const Character &character, const mat4 &cameraProjView, vec3 cameraPosition, const DirectionLight &light)
+//rays from a sphere around the first evaluated character to points inside its bounds
+static void run_raycast_benchmark()
 {
-  const Material &material = *character.material;
-  const Shader &shader = material.get_shader();
+  auto character = std::find_if(scene->characters.begin(), scene->characters.end(),
+    [](const Character &c) { return c.evaluated && c.raycastModel; });
+  if (character == scene->characters.end())
+    return;
+  const SkinnedRaycastModel &model = *character->raycastModel;
+  const mat4 *palette = animation_palette(character->animation).data();
+  SkinnedRaycastState &state = character->raycast;
+  refit_skinned_bvh(model, palette, scene->frameIndex, state);
 
-  shader.use();
-  material.bind_uniforms_to_shader();
-  shader.set_mat4x4("Transform", character.transform);
-  shader.set_mat4x4("ViewProjection", cameraProjView);
-  shader.set_vec3("CameraPosition", cameraPosition);
-  shader.set_vec3("LightDirection", glm::normalize(light.lightDirection));
-  shader.set_vec3("AmbientLight", light.ambient);
-  shader.set_vec3("SunLight", light.lightColor);
+  //model space rays, the palette doesn't include the character transform
+  BoundingBox bounds;
+  for (const vec3 &p : state.positions)
+    bounds.add(p);
+  vec3 center = (bounds.min + bounds.max) * 0.5f;
+  float radius = length(bounds.max - bounds.min);
+  const int rayCount = 2000;
+  std::mt19937 random(0);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+  std::vector<vec3> origins(rayCount), directions(rayCount);
+  for (int i = 0; i < rayCount; i++)
+  {
+    vec3 onSphere = normalize(vec3(uniform(random), uniform(random), uniform(random)) * 2.f - 1.f);
+    origins[i] = center + onSphere * radius;
+    vec3 target = mix(bounds.min, bounds.max, vec3(uniform(random), uniform(random), uniform(random)));
+    directions[i] = normalize(target - origins[i]);
+  }
 
-  render(character.mesh);
+  std::vector<RayHit> bvhHits(rayCount), bruteForceHits(rayCount);
+  int rejected = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < rayCount; i++)
+    if (raycast_joint_capsules(model, palette, origins[i], directions[i], 2.f * radius))
+      raycast_skinned_mesh(model, state, origins[i], directions[i], bvhHits[i]);
+    else
+      rejected++;
+  auto middle = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < rayCount; i++)
+    raycast_skinned_mesh_brute_force(model, state, origins[i], directions[i], bruteForceHits[i]);
+  auto end = std::chrono::high_resolution_clock::now();
+  //refit cost of one query frame
+  state.version = -1;
+  refit_skinned_bvh(model, palette, scene->frameIndex, state);
+  std::chrono::duration<float, std::milli> refitTime = std::chrono::high_resolution_clock::now() - end;
+
+  int mismatches = 0;
+  for (int i = 0; i < rayCount; i++)
+    mismatches += (bvhHits[i].triangle >= 0) != (bruteForceHits[i].triangle >= 0) ||
+      glm::abs(bvhHits[i].distance - bruteForceHits[i].distance) > 1e-4f * radius;
+
+  std::chrono::duration<float> bvhTime = middle - start, bruteForceTime = end - middle;
+  scene->raycastBenchmark = vec3(rayCount / bvhTime.count(), rayCount / bruteForceTime.count(), float(rejected) / rayCount);
+  debug_log("raycast, %d triangles: bvh %.0f rays/s, brute force %.0f rays/s, capsules rejected %.0f%%, refit %.3f ms, %d mismatches",
+    (int)model.triangles.size(), scene->raycastBenchmark.x, scene->raycastBenchmark.y, 100.f * scene->raycastBenchmark.z,
+    refitTime.count(), mismatches);
+}
+
+//head of every character, lazy chains in new frames against full evaluations
+static void run_joint_query_benchmark()
+{
+  std::vector<Character> &characters = scene->characters;
+  if (characters.empty() || scene->headJoint < 0)
+    return;
+  const int iterations = 20;
+  vec3 sum = vec3(0.f);
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < iterations; i++)
+    for (Character &character : characters)
+      sum += vec3(query_joint_transform(character.animation, character.jointQueries, scene->headJoint, -2 - i)[3]);
+  auto middle = std::chrono::high_resolution_clock::now();
+  AnimationPlayer player;
+  init_animation_player(player, characters[0].animation.skeleton);
+  for (int i = 0; i < iterations; i++)
+    for (Character &character : characters)
+    {
+      //copies the clip state, evaluation writes only buffers of the copy
+      const AnimationPlayer &animation = character.animation;
+      player.clip = animation.clip;
+      player.time = animation.time;
+      player.prevClip = animation.prevClip;
+      player.prevTime = animation.prevTime;
+      player.blendTime = animation.blendTime;
+      player.blendDuration = animation.blendDuration;
+      player.inertialization = animation.inertialization;
+      player.layers = animation.layers;
+      player.lod = 0;
+      evaluate_animation_player(player);
+      sum -= vec3(player.modelPose[scene->headJoint][3]);
+    }
+  auto end = std::chrono::high_resolution_clock::now();
+  //joints were evaluated with frames nobody else uses
+  for (Character &character : characters)
+    character.jointQueries.frame = -1;
+
+  int queries = iterations * characters.size();
+  std::chrono::duration<float, std::micro> queryTime = middle - start, evaluationTime = end - middle;
+  scene->jointQueryBenchmark = vec2(queryTime.count(), evaluationTime.count()) / float(queries);
+  debug_log("head query: chain %.2f us, full pose %.2f us, difference %f",
+    scene->jointQueryBenchmark.x, scene->jointQueryBenchmark.y, length(sum) / queries);
+}
+
+void game_imgui()
+{
+  const AnimationStats &stats = scene->animationStats;
+  ImGui::Begin("Animation");
+  ImGui::Text("characters %d, evaluated %d", (int)scene->characters.size(), stats.evaluatedCharacters.load());
+  ImGui::Text("evaluated joints %d", stats.evaluatedJoints.load());
+  const RenderStats &renderStats = scene->renderQueue.stats;
+  ImGui::Text("draws %d in %d calls, binds: program %d, material %d, mesh %d", renderStats.draws, renderStats.drawCalls,
+    renderStats.programBinds, renderStats.materialBinds, renderStats.meshBinds);
+  const GeometryPoolStats &poolStats = get_geometry_pool_stats();
+  ImGui::Text("geometry pools %d: meshes %d, vertices %d, indices %d", poolStats.pools, poolStats.meshes,
+    poolStats.vertices, poolStats.indices);
+  const GlStateStats &glStats = get_gl_state_stats();
+  ImGui::Text("gl state calls %d, filtered %d", glStats.calls, glStats.filtered);
+  ImGui::Text("draw data %d KB, ring buffer stalls %d", renderStats.drawDataBytes / 1024, scene->renderQueue.drawData.stalls);
+  ImGui::Text("skinned bounds %.3f ms", scene->skinnedBoundsMs);
+  ImGui::Text("visible %d of %d, culling %.3f ms", (int)scene->visibleCharacters.size(), scene->characterBounds.count, scene->cullingMs);
+  ImGui::Checkbox("occlusion culling", &scene->useOcclusionCulling);
+  if (scene->useOcclusionCulling)
+    ImGui::Text("occluders %d, triangles %d, occluded %d, %.3f ms", scene->occlusion.occluders,
+      (int)scene->occlusion.triangles.size(), stats.occludedCharacters.load(), scene->occlusionMs);
+  if (scene->layerWeights.size() == 2)
+  {
+    ImGui::SliderFloat("upper body layer", &scene->layerWeights[0], 0.f, 1.f);
+    ImGui::SliderFloat("additive layer", &scene->layerWeights[1], 0.f, 1.f);
+    ImGui::Text("layer joints %d", stats.layerJoints.load());
+  }
+  bool inertialization = scene->transition == AnimationTransition::Inertialization;
+  if (ImGui::Checkbox("inertialization", &inertialization))
+    scene->transition = inertialization ? AnimationTransition::Inertialization : AnimationTransition::Crossfade;
+  const PoseCache &cache = scene->poseCache;
+  ImGui::Checkbox("pose cache", &scene->usePoseCache);
+  if (scene->usePoseCache)
+  {
+    ImGui::SliderFloat("time quantization", &scene->poseCache.timeQuantization, 1.f / 120.f, 0.2f);
+    int lookups = cache.lookups.load();
+    ImGui::Text("pose cache hits %d/%d (%.0f%%), uncacheable %d",
+      cache.hits.load(), lookups, lookups > 0 ? 100.f * cache.hits.load() / lookups : 0.f, cache.bypasses.load());
+  }
+  ImGui::Checkbox("root motion", &scene->rootMotion);
+  ImGui::SameLine();
+  if (ImGui::Button("reset positions"))
+    for (int i = 0, n = scene->characters.size(); i < n; i++)
+      scene->characters[i].transform = crowd_transform(i);
+  ImGui::Text("sampled clips %d, with crossfades %d", stats.sampledClips.load(), stats.crossfadeSampledClips.load());
+  ImGui::Text("poses from cache %d", stats.cachedPoses.load());
+  ImGui::Text("job threads %d", get_job_thread_count());
+  if (ImGui::Button("threads benchmark"))
+    run_threads_benchmark();
+  for (const vec2 &result : scene->threadsBenchmark)
+    ImGui::Text("%d threads: %.3f ms, x%.2f", int(result.x), result.y, scene->threadsBenchmark[0].y / result.y);
+  const char *footIkSolvers[] = {"off", "two bone", "ccd", "fabrik"};
+  int footIk = (int)scene->footIk;
+  if (ImGui::Combo("foot ik", &footIk, footIkSolvers, IM_ARRAYSIZE(footIkSolvers)))
+    scene->footIk = (FootIk)footIk;
+  if (scene->footIk != FootIk::Off)
+  {
+    ImGui::SliderFloat("ground height", &scene->groundHeight, 0.f, 0.5f);
+    ImGui::Text("foot ik %d legs, %.3f ms", scene->footIkBatch.size, scene->footIkMs);
+  }
+  if (scene->springBones)
+  {
+    ImGui::Checkbox("spring bones", &scene->useSpringBones);
+    if (scene->useSpringBones)
+      ImGui::Text("spring bones %d chains, %.3f ms", (int)scene->springBones->chains.size(), scene->springBonesMs);
+  }
+  if (scene->morphVertices > 0)
+  {
+    ImGui::SliderFloat("morph weight epsilon", &scene->morphEpsilon, 0.f, 0.5f);
+    ImGui::Text("morph targets: %d/%d vertices (%.1f%%), %.3f ms", scene->morphTouchedVertices, scene->morphVertices,
+      100.f * scene->morphTouchedVertices / scene->morphVertices, scene->morphMs);
+  }
+  ImGui::Text("picked character %d (right click), distance %.2f", scene->pickedCharacter, scene->pickedDistance);
+  ImGui::Checkbox("camera follows picked head", &scene->followPicked);
+  ImGui::SameLine();
+  ImGui::Checkbox("follow character 0", &scene->followFirst);
+  if (scene->followPicked)
+    ImGui::Text("head from %s", scene->headQueried ? "joint query" : "evaluated pose");
+  if (ImGui::Button("joint query benchmark"))
+    run_joint_query_benchmark();
+  ImGui::Text("head query: chain %.2f us, full pose %.2f us", scene->jointQueryBenchmark.x, scene->jointQueryBenchmark.y);
+  if (ImGui::Button("raycast benchmark"))
+    run_raycast_benchmark();
+  ImGui::Text("rays/s: bvh %.0f, brute force %.0f, capsules rejected %.0f%%",
+    scene->raycastBenchmark.x, scene->raycastBenchmark.y, 100.f * scene->raycastBenchmark.z);
+  if (scene->motionDatabase)
+  {
+    if (ImGui::Button("motion matching benchmark"))
+      run_motion_matching_benchmark();
+    ImGui::Text("search per query: brute force %.2f us, hierarchy %.2f us",
+      scene->motionMatchingBenchmark.x, scene->motionMatchingBenchmark.y);
+  }
+  ImGui::End();
 }
 
 void game_render()
 {
-  glEnable(GL_DEPTH_TEST);
-  glDisable(GL_BLEND);
+  //imgui and other code outside the cache ran since the last frame
+  reset_gl_state_cache();
+  gl_set_enabled(GL_DEPTH_TEST, true);
+  gl_set_enabled(GL_BLEND, false);
   const float grayColor = 0.3f;
   glClearColor(grayColor, grayColor, grayColor, 1.f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -109,6 +924,33 @@ void game_render()
   const glm::mat4 &transform = scene->userCamera.transform;
   mat4 projView = projection * inverse(transform);
 
-  for (const Character &character : scene->characters)
-    render_character(character, projView, glm::vec3(transform[3]), scene->light);
-}
\ No newline at end of file
+  const DirectionLight &light = scene->light;
+  GlobalRenderData globalData;
+  globalData.viewProjection = projView;
+  globalData.cameraPosition = vec4(vec3(transform[3]), 1.f);
+  globalData.lightDirection = vec4(glm::normalize(light.lightDirection), 0.f);
+  globalData.ambientLight = vec4(light.ambient, 0.f);
+  globalData.sunLight = vec4(light.lightColor, 0.f);
+  update_global_render_data(globalData);
+
+  //characters which weren't evaluated are out of view, others are tested with the tight skinned bounds
+  auto start = std::chrono::high_resolution_clock::now();
+  cull_bounds(scene->characterBounds, extract_frustum(projView), scene->visibleCharacters);
+  std::chrono::duration<float, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+  scene->cullingMs = time.count();
+
+  vec3 cameraPosition = vec3(transform[3]);
+  RenderQueue &queue = scene->renderQueue;
+  clear_render_queue(queue);
+  for (uint32_t i : scene->visibleCharacters)
+  {
+    const Character &character = scene->characters[i];
+    const std::vector<mat4> &palette = animation_palette(character.animation);
+    float depth = length(vec3(character.transform[3]) - cameraPosition) / CameraFarPlane;
+    const MorphState *morph = character.mesh->morphTargets ? &character.morph : nullptr;
+    add_draw_item(queue, RenderPass::Opaque, character.mesh, character.material, character.transform,
+      palette.data(), palette.size(), depth, morph);
+  }
+  sort_render_queue(queue);
+  submit_render_queue(queue);
+}
@@ -0,0 +1,149 @@
+#include "geometry_pool.h"
+#include "glad/glad.h"
+#include "gl_state.h"
+#include <log.h>
+#include <algorithm>
+
+struct GeometryPool
+{
+  uint32_t format;
+  GLuint vertexArray;
+  GLuint channelBuffers[VertexChannelCount];
+  int channelSizes[VertexChannelCount];
+  GLuint indexBuffer;
+  int vertexCount, vertexCapacity;
+  int indexCount, indexCapacity;
+};
+
+static std::vector<GeometryPool> pools;
+static GeometryPoolStats stats;
+static GLuint drawIndexBuffer = 0;
+
+static const int InitialPoolVertices = 1 << 16;
+static const int InitialPoolIndices = 1 << 18;
+
+static void set_channel_pointer(int channel, const VertexChannel &format)
+{
+  glEnableVertexAttribArray(channel);
+  if (format.isFloat)
+    glVertexAttribPointer(channel, format.componentCount, GL_FLOAT, GL_FALSE, 0, 0);
+  else
+    glVertexAttribIPointer(channel, format.componentCount, GL_UNSIGNED_INT, 0, 0);
+}
+
+//copies the used part to a larger buffer, the old one is deleted
+static GLuint grow_buffer(GLenum target, GLuint buffer, int used_size, int new_size)
+{
+  GLuint newBuffer;
+  glGenBuffers(1, &newBuffer);
+  glBindBuffer(target, newBuffer);
+  glBufferData(target, new_size, nullptr, GL_STATIC_DRAW);
+  if (buffer)
+  {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, target, 0, 0, used_size);
+    glDeleteBuffers(1, &buffer);
+  }
+  return newBuffer;
+}
+
+static GeometryPool &find_pool(uint32_t format, const VertexChannel *channels)
+{
+  for (GeometryPool &pool : pools)
+    if (pool.format == format)
+      return pool;
+
+  GeometryPool pool = {};
+  pool.format = format;
+  for (int i = 0; i < VertexChannelCount; i++)
+    pool.channelSizes[i] = channels[i].componentCount * 4;
+  glGenVertexArrays(1, &pool.vertexArray);
+  gl_bind_vertex_array(pool.vertexArray);
+  init_draw_index_attribute();
+  pools.push_back(pool);
+  stats.pools = pools.size();
+  return pools.back();
+}
+
+static void reserve_vertices(GeometryPool &pool, int count, const VertexChannel *channels)
+{
+  if (pool.vertexCount + count <= pool.vertexCapacity)
+    return;
+  int capacity = std::max(pool.vertexCapacity, InitialPoolVertices);
+  while (capacity < pool.vertexCount + count)
+    capacity *= 2;
+  gl_bind_vertex_array(pool.vertexArray);
+  for (int i = 0; i < VertexChannelCount; i++)
+    if (pool.format & (1u << i))
+    {
+      pool.channelBuffers[i] = grow_buffer(GL_ARRAY_BUFFER, pool.channelBuffers[i],
+        pool.vertexCount * pool.channelSizes[i], capacity * pool.channelSizes[i]);
+      //the vertex array keeps the buffer bound at glVertexAttribPointer time
+      set_channel_pointer(i, channels[i]);
+    }
+  pool.vertexCapacity = capacity;
+}
+
+static void reserve_indices(GeometryPool &pool, int count)
+{
+  if (pool.indexCount + count <= pool.indexCapacity)
+    return;
+  int capacity = std::max(pool.indexCapacity, InitialPoolIndices);
+  while (capacity < pool.indexCount + count)
+    capacity *= 2;
+  //the element buffer binding is part of the vertex array state
+  gl_bind_vertex_array(pool.vertexArray);
+  pool.indexBuffer = grow_buffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer,
+    pool.indexCount * sizeof(uint32_t), capacity * sizeof(uint32_t));
+  pool.indexCapacity = capacity;
+}
+
+GeometryRange add_pooled_geometry(const std::vector<uint32_t> &indices, int vertex_count, const VertexChannel *channels)
+{
+  uint32_t format = 0;
+  for (int i = 0; i < VertexChannelCount; i++)
+    if (channels[i].data)
+      format |= 1u << i;
+
+  GeometryPool &pool = find_pool(format, channels);
+  reserve_vertices(pool, vertex_count, channels);
+  reserve_indices(pool, indices.size());
+  for (int i = 0; i < VertexChannelCount; i++)
+    if (format & (1u << i))
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, pool.channelBuffers[i]);
+      glBufferSubData(GL_ARRAY_BUFFER, pool.vertexCount * pool.channelSizes[i], vertex_count * pool.channelSizes[i], channels[i].data);
+    }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, pool.indexCount * sizeof(uint32_t), indices.size() * sizeof(uint32_t), indices.data());
+
+  GeometryRange range = {pool.vertexArray, pool.indexCount, pool.vertexCount};
+  pool.vertexCount += vertex_count;
+  pool.indexCount += indices.size();
+  stats.meshes++;
+  stats.vertices += vertex_count;
+  stats.indices += indices.size();
+  return range;
+}
+
+const GeometryPoolStats &get_geometry_pool_stats()
+{
+  return stats;
+}
+
+void init_draw_index_attribute()
+{
+  if (!drawIndexBuffer)
+  {
+    std::vector<uint32_t> identity(MaxDrawsPerFrame);
+    for (int i = 0; i < MaxDrawsPerFrame; i++)
+      identity[i] = i;
+    glGenBuffers(1, &drawIndexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, identity.size() * sizeof(uint32_t), identity.data(), GL_STATIC_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+  glEnableVertexAttribArray(DrawIndexLocation);
+  glVertexAttribIPointer(DrawIndexLocation, 1, GL_UNSIGNED_INT, 0, 0);
+  glVertexAttribDivisor(DrawIndexLocation, 1);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+//position, normal, uv, bone weights, bone indices at attribute locations 0-4
+constexpr int VertexChannelCount = 5;
+//instanced attribute with the index of the draw item, see character_vs.glsl
+constexpr int DrawIndexLocation = 7;
+constexpr int MaxDrawsPerFrame = 1 << 16;
+
+//4 byte components, floats or unsigned ints, data is nullptr for missing channels
+struct VertexChannel
+{
+  const void *data;
+  int componentCount;
+  bool isFloat;
+};
+
+//where the mesh is in the shared buffers
+struct GeometryRange
+{
+  uint32_t vertexArray;
+  int firstIndex;
+  int baseVertex;
+};
+
+//meshes with the same channels share one vertex array, vertex and index buffers
+//grow by doubling, so existing ranges stay valid
+GeometryRange add_pooled_geometry(const std::vector<uint32_t> &indices, int vertex_count, const VertexChannel *channels);
+
+struct GeometryPoolStats
+{
+  int pools = 0;
+  int meshes = 0;
+  int vertices = 0;
+  int indices = 0;
+};
+
+const GeometryPoolStats &get_geometry_pool_stats();
+
+//binds the identity buffer 0, 1, 2, ... to DrawIndexLocation of the bound vertex array with divisor 1,
+//so the attribute equals the base instance of the draw
+void init_draw_index_attribute();
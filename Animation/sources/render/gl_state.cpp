@@ -0,0 +1,156 @@
+#include "gl_state.h"
+
+constexpr int MaxTextureUnits = 32;
+constexpr int MaxBufferBindings = 16;
+constexpr int MaxCapabilities = 8;
+
+struct BufferBinding
+{
+  GLuint buffer;
+  GLintptr offset;
+  GLsizeiptr size;
+};
+
+//~0u is unknown state, it never matches a real name
+struct GlStateCache
+{
+  GLuint program;
+  GLuint vertexArray;
+  int activeTexture;
+  GLuint textures[MaxTextureUnits];
+  GLenum textureTargets[MaxTextureUnits];
+  BufferBinding uniformBuffers[MaxBufferBindings];
+  BufferBinding storageBuffers[MaxBufferBindings];
+  GLenum capabilities[MaxCapabilities];
+  //0, 1 or -1 for unknown
+  int capabilityStates[MaxCapabilities];
+  int capabilityCount;
+  GlStateStats stats;
+};
+
+static GlStateCache cache;
+static const GLuint Unknown = ~0u;
+
+void reset_gl_state_cache()
+{
+  cache.program = Unknown;
+  cache.vertexArray = Unknown;
+  cache.activeTexture = -1;
+  for (int i = 0; i < MaxTextureUnits; i++)
+    cache.textures[i] = Unknown;
+  for (int i = 0; i < MaxBufferBindings; i++)
+  {
+    cache.uniformBuffers[i] = BufferBinding{Unknown, 0, 0};
+    cache.storageBuffers[i] = BufferBinding{Unknown, 0, 0};
+  }
+  for (int i = 0; i < cache.capabilityCount; i++)
+    cache.capabilityStates[i] = -1;
+  cache.stats = GlStateStats();
+}
+
+const GlStateStats &get_gl_state_stats()
+{
+  return cache.stats;
+}
+
+//counts the call and returns true if it must be issued
+static bool changed(bool different)
+{
+  cache.stats.calls++;
+  if (!different)
+    cache.stats.filtered++;
+  return different;
+}
+
+void gl_use_program(GLuint program)
+{
+  if (changed(cache.program != program))
+  {
+    glUseProgram(program);
+    cache.program = program;
+  }
+}
+
+void gl_bind_vertex_array(GLuint vertex_array)
+{
+  if (changed(cache.vertexArray != vertex_array))
+  {
+    glBindVertexArray(vertex_array);
+    cache.vertexArray = vertex_array;
+  }
+}
+
+void gl_bind_texture(int unit, GLenum target, GLuint texture)
+{
+  bool known = unit < MaxTextureUnits;
+  if (!changed(!known || cache.textures[unit] != texture || cache.textureTargets[unit] != target))
+    return;
+  if (cache.activeTexture != unit)
+  {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    cache.activeTexture = unit;
+  }
+  glBindTexture(target, texture);
+  if (known)
+  {
+    cache.textures[unit] = texture;
+    cache.textureTargets[unit] = target;
+  }
+}
+
+static BufferBinding *buffer_binding(GLenum target, int index)
+{
+  if (index >= MaxBufferBindings)
+    return nullptr;
+  if (target == GL_UNIFORM_BUFFER)
+    return &cache.uniformBuffers[index];
+  if (target == GL_SHADER_STORAGE_BUFFER)
+    return &cache.storageBuffers[index];
+  return nullptr;
+}
+
+void gl_bind_buffer_base(GLenum target, int index, GLuint buffer)
+{
+  //size 0 marks the whole buffer
+  BufferBinding *binding = buffer_binding(target, index);
+  if (changed(!binding || binding->buffer != buffer || binding->size != 0))
+  {
+    glBindBufferBase(target, index, buffer);
+    if (binding)
+      *binding = BufferBinding{buffer, 0, 0};
+  }
+}
+
+void gl_bind_buffer_range(GLenum target, int index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+  BufferBinding *binding = buffer_binding(target, index);
+  if (changed(!binding || binding->buffer != buffer || binding->offset != offset || binding->size != size))
+  {
+    glBindBufferRange(target, index, buffer, offset, size);
+    if (binding)
+      *binding = BufferBinding{buffer, offset, size};
+  }
+}
+
+void gl_set_enabled(GLenum capability, bool enabled)
+{
+  int i = 0;
+  while (i < cache.capabilityCount && cache.capabilities[i] != capability)
+    i++;
+  if (i == cache.capabilityCount && i < MaxCapabilities)
+  {
+    cache.capabilities[i] = capability;
+    cache.capabilityStates[i] = -1;
+    cache.capabilityCount++;
+  }
+  bool known = i < MaxCapabilities;
+  if (changed(!known || cache.capabilityStates[i] != (int)enabled))
+  {
+    if (enabled)
+      glEnable(capability);
+    else
+      glDisable(capability);
+    if (known)
+      cache.capabilityStates[i] = enabled;
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "glad/glad.h"
+
+//calls which would set the state already bound are dropped, everything goes through these functions
+//so the cache matches the context, reset_gl_state_cache forgets it after foreign gl code
+
+struct GlStateStats
+{
+  int calls = 0;
+  int filtered = 0;
+};
+
+//forgets the cached state and the stats, once per frame
+void reset_gl_state_cache();
+const GlStateStats &get_gl_state_stats();
+
+void gl_use_program(GLuint program);
+void gl_bind_vertex_array(GLuint vertex_array);
+//also switches the active texture unit if the binding changes
+void gl_bind_texture(int unit, GLenum target, GLuint texture);
+//GL_UNIFORM_BUFFER and GL_SHADER_STORAGE_BUFFER indexed bindings
+void gl_bind_buffer_base(GLenum target, int index, GLuint buffer);
+void gl_bind_buffer_range(GLenum target, int index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+//GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and other glEnable capabilities
+void gl_set_enabled(GLenum capability, bool enabled);
@@ -0,0 +1,18 @@
+#include "global_render_data.h"
+#include "glad/glad.h"
+#include "gl_state.h"
+
+static GLuint globalRenderDataBuffer = 0;
+
+void update_global_render_data(const GlobalRenderData &data)
+{
+  if (!globalRenderDataBuffer)
+  {
+    glGenBuffers(1, &globalRenderDataBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, globalRenderDataBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GlobalRenderData), nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, globalRenderDataBuffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GlobalRenderData), &data);
+  gl_bind_buffer_base(GL_UNIFORM_BUFFER, GlobalRenderDataBinding, globalRenderDataBuffer);
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "3dmath.h"
+
+constexpr int GlobalRenderDataBinding = 0;
+
+//per frame data of all shaders, matches the std140 GlobalRenderData block, vec3 are padded to vec4
+struct GlobalRenderData
+{
+  mat4 viewProjection;
+  vec4 cameraPosition;
+  vec4 lightDirection;
+  vec4 ambientLight;
+  vec4 sunLight;
+};
+
+//uploads the data once per frame and binds the buffer to GlobalRenderDataBinding
+void update_global_render_data(const GlobalRenderData &data);
@@ -1,34 +1,49 @@
 #include "material.h"
+#include <cstring>
 
 
-void Material::bind_uniforms_to_shader() const
+void Material::rebuild() const
 {
-  const auto &uniforms = shader->uniforms;
-
-  int textureBinding = 0;
+  constants.assign(shader->materialDataSize, 0);
+  textures.clear();
   for (const Property &property : properties)
   {
-
-    int location = uniforms[property.shaderUniformIdx].shaderLocation;
-    if (const auto *v = std::get_if<float>(&property.value))
-      shader->set_float(location, *v);
-    else if (const auto *v = std::get_if<glm::vec2>(&property.value))
-      shader->set_vec2(location, *v);
-    else if (const auto *v = std::get_if<glm::vec3>(&property.value))
-      shader->set_vec3(location, *v);
-    else if (const auto *v = std::get_if<glm::vec4>(&property.value))
-      shader->set_vec4(location, *v);
-    else if (const auto *v = std::get_if<Texture2DPtr>(&property.value))
+    if (const auto *v = std::get_if<Texture2DPtr>(&property.value))
     {
-      unsigned textureObject = (*v)->textureObject;
-      glActiveTexture(GL_TEXTURE0 + textureBinding);
-      glBindTexture(GL_TEXTURE_2D, textureObject);
-      glUniform1i(location, textureBinding);
-      textureBinding++;
+      //units belong to the shader, other materials of the program use the same ones
+      int unit = shader->get_sampler_unit(property.id);
+      if (unit >= 0)
+        textures.push_back(TextureBinding{unit, (*v)->textureObject});
+      continue;
     }
+    int offset = shader->get_material_offset(property.id);
+    if (offset < 0)
+      continue;
+    std::visit([&](const auto &value)
+    {
+      if constexpr (!std::is_same_v<std::decay_t<decltype(value)>, Texture2DPtr>)
+        memcpy(&constants[offset], &value, sizeof(value));
+    }, property.value);
   }
-}
-
 
+  if (!constants.empty())
+  {
+    if (!constantBuffer)
+      glGenBuffers(1, &constantBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, constantBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, constants.size(), constants.data(), GL_STATIC_DRAW);
+  }
+  builtProgram = shader->program;
+  dirty = false;
+}
 
+void Material::bind_uniforms_to_shader() const
+{
+  if (dirty || builtProgram != shader->program)
+    rebuild();
 
+  if (!constants.empty())
+    gl_bind_buffer_range(GL_UNIFORM_BUFFER, MaterialDataBinding, constantBuffer, 0, constants.size());
+  for (const TextureBinding &texture : textures)
+    gl_bind_texture(texture.unit, GL_TEXTURE_2D, texture.textureObject);
+}
@@ -9,52 +9,86 @@
   TYPE(float, GL_FLOAT) TYPE(vec2, GL_FLOAT_VEC2) TYPE(vec3, GL_FLOAT_VEC3) TYPE(vec4, GL_FLOAT_VEC4) TYPE(Texture2DPtr, GL_SAMPLER_2D)\
 
 
+//non texture properties live in a per material copy of the std140 MaterialData block, binding is
+//one buffer range and the precomputed texture list
 class Material
 {
 private:
   ShaderPtr shader;
   using MaterialProperty = std::variant<float, glm::vec2, glm::vec3, glm::vec4, Texture2DPtr>;
 
+  //offsets and locations are looked up by id on rebuild, so they stay valid after shader hot reload
   struct Property
   {
-    std::string name;
-    int shaderUniformIdx;
+    UniformId id;
     MaterialProperty value;
   };
   std::vector<Property> properties;
 
+  struct TextureBinding
+  {
+    int unit;
+    unsigned textureObject;
+  };
+
+  //rebuilt on the next bind after set_property or shader reload
+  mutable std::vector<char> constants;
+  mutable uint32_t constantBuffer = 0;
+  mutable std::vector<TextureBinding> textures;
+  mutable uint32_t builtProgram = 0;
+  mutable bool dirty = true;
+
+  void rebuild() const;
+
+  static inline uint32_t materialCount = 0;
+
 public:
+  //small unique number for sort keys
+  const uint32_t id;
 
-  Material(ShaderPtr &&shader) : shader(std::move(shader)) {}
+  Material(ShaderPtr &&shader) : shader(std::move(shader)), id(materialCount++) {}
 
   const Shader &get_shader() const { return *shader; }
+  //first texture property, 0 if there are no textures
+  unsigned main_texture() const
+  {
+    for (const Property &property : properties)
+      if (const auto *v = std::get_if<Texture2DPtr>(&property.value))
+        return (*v)->textureObject;
+    return 0;
+  }
   void bind_uniforms_to_shader() const;
 
   template<typename T>
-  bool set_property(const char *name, T &&value)
+  bool set_property(UniformId id, T &&value)
   {
     for (Property &p : properties)
     {
-      if (p.name == name)
+      if (p.id.index == id.index)
       {
         p.value = std::move(value);
+        dirty = true;
         return true;
       }
     }
 
-    int i = 0;
-    for (const ShaderUniform &sampler : shader->uniforms)
+    constexpr bool isTexture = std::is_same_v<std::decay_t<T>, Texture2DPtr>;
+    if (isTexture ? shader->get_sampler_unit(id) >= 0 : shader->get_material_offset(id) >= 0)
     {
-      if (sampler.name == name)
-      {
-        properties.emplace_back(Property{std::string(name), i, MaterialProperty{std::move(value)}});
-        return true;
-      }
-      i++;
+      properties.emplace_back(Property{id, MaterialProperty{std::move(value)}});
+      dirty = true;
+      return true;
     }
-    debug_error("property %s in shader %s didn't found", name, shader->name.c_str());
+    debug_error("property %s in shader %s didn't found%s", get_uniform_name(id).c_str(), shader->name.c_str(),
+      isTexture ? "" : " in MaterialData block");
     return false;
   }
+
+  template<typename T>
+  bool set_property(const char *name, T &&value)
+  {
+    return set_property(get_uniform_id(name), std::forward<T>(value));
+  }
 };
 
 using MaterialPtr = std::shared_ptr<Material>;
@@ -1,4 +1,5 @@
 #include "mesh.h"
+#include "morph_targets.h"
 #include <vector>
 #include <3dmath.h>
 #include <assimp/scene.h>
@@ -6,6 +7,8 @@
 #include <assimp/postprocess.h>
 #include <log.h>
 #include "glad/glad.h"
+#include "gl_state.h"
+#include "geometry_pool.h"
 
 
 static void create_indices(const std::vector<unsigned int> &indices)
@@ -14,52 +17,64 @@ static void create_indices(const std::vector<unsigned int> &indices)
   glGenBuffers(1, &arrayIndexBuffer);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arrayIndexBuffer);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
-  glBindVertexArray(0);
+  gl_bind_vertex_array(0);
 }
 
-static void init_channel(int index, size_t data_size, const void *data_ptr, int component_count, bool is_float)
+static void init_channel(int index, int vertex_count, const VertexChannel &channel)
 {
   GLuint arrayBuffer;
   glGenBuffers(1, &arrayBuffer);
   glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-  glBufferData(GL_ARRAY_BUFFER, data_size, data_ptr, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, vertex_count * channel.componentCount * 4, channel.data, GL_STATIC_DRAW);
   glEnableVertexAttribArray(index);
 
-  if (is_float)
-    glVertexAttribPointer(index, component_count, GL_FLOAT, GL_FALSE, 0, 0);
+  if (channel.isFloat)
+    glVertexAttribPointer(index, channel.componentCount, GL_FLOAT, GL_FALSE, 0, 0);
   else
-    glVertexAttribIPointer(index, component_count, GL_UNSIGNED_INT, 0, 0);
+    glVertexAttribIPointer(index, channel.componentCount, GL_UNSIGNED_INT, 0, 0);
 }
 
 
 template<int i>
-static void InitChannel() { }
+static void CollectChannel(VertexChannel *, int &) { }
 
 template<int i, typename T, typename... Channel>
-static void InitChannel(const std::vector<T> &channel, const Channel&... channels)
+static void CollectChannel(VertexChannel *result, int &vertex_count, const std::vector<T> &channel, const Channel&... channels)
 {
-  if (channel.size() > 0)
-  {
-    const int size = sizeof(T) / sizeof(channel[0][0]);
-    init_channel(i, sizeof(T) * channel.size(), channel.data(), size, !(std::is_same<T, uvec4>::value));
-  }
-  InitChannel<i + 1>(channels...);
+  const int size = sizeof(T) / sizeof(channel[0][0]);
+  result[i] = VertexChannel{channel.empty() ? nullptr : channel.data(), size, !(std::is_same<T, uvec4>::value)};
+  if (!channel.empty())
+    vertex_count = channel.size();
+  CollectChannel<i + 1>(result, vertex_count, channels...);
 }
 
 
 template<typename... Channel>
-MeshPtr create_mesh(const std::vector<unsigned int> &indices, const Channel&... channels)
+MeshPtr create_mesh(const std::vector<unsigned int> &indices, bool pooled, const Channel&... channels)
 {
+  static_assert(sizeof...(Channel) <= VertexChannelCount);
+  VertexChannel vertexChannels[VertexChannelCount] = {};
+  int vertexCount = 0;
+  CollectChannel<0>(vertexChannels, vertexCount, channels...);
+  if (pooled)
+  {
+    GeometryRange range = add_pooled_geometry(indices, vertexCount, vertexChannels);
+    return std::make_shared<Mesh>(range.vertexArray, indices.size(), range.firstIndex, range.baseVertex);
+  }
+
   uint32_t vertexArrayBufferObject;
   glGenVertexArrays(1, &vertexArrayBufferObject);
-  glBindVertexArray(vertexArrayBufferObject);
-  InitChannel<0>(channels...);
+  gl_bind_vertex_array(vertexArrayBufferObject);
+  for (int i = 0; i < VertexChannelCount; i++)
+    if (vertexChannels[i].data)
+      init_channel(i, vertexCount, vertexChannels[i]);
+  init_draw_index_attribute();
   create_indices(indices);
   return std::make_shared<Mesh>(vertexArrayBufferObject, indices.size());
 }
 
 
-MeshPtr create_mesh(const aiMesh *mesh)
+MeshPtr create_mesh(const aiMesh *mesh, const std::vector<int> &bone_remap)
 {
   std::vector<uint32_t> indices;
   std::vector<vec3> vertices;
@@ -112,14 +127,14 @@ MeshPtr create_mesh(const aiMesh *mesh)
     for (int i = 0; i < numBones; i++)
     {
       const aiBone *bone = mesh->mBones[i];
-      //bonesMap[std::string(bone->mName.C_Str())] = i;
+      int joint = bone_remap.empty() ? i : bone_remap[i];
 
       for (unsigned j = 0; j < bone->mNumWeights; j++)
       {
         int vertex = bone->mWeights[j].mVertexId;
         int offset = weightsOffset[vertex]++;
         weights[vertex][offset] = bone->mWeights[j].mWeight;
-        weightsIndex[vertex][offset] = i;
+        weightsIndex[vertex][offset] = joint;
       }
     }
     //the sum of weights not 1
@@ -127,23 +142,34 @@ MeshPtr create_mesh(const aiMesh *mesh)
     {
       vec4 w = weights[i];
       float s = w.x + w.y + w.z + w.w;
-      weights[i] *= 1.f / s;
+      if (s > 0.f)
+        weights[i] *= 1.f / s;
+      else
+        weights[i] = vec4(1.f, 0.f, 0.f, 0.f);
     }
   }
-  return create_mesh(indices, vertices, normals, uv, weights, weightsIndex);
+  //morph offsets are indexed from the first vertex of the buffer, so these meshes can't be pooled
+  MorphTargetSetPtr morphTargets = import_morph_targets(mesh);
+  MeshPtr result = create_mesh(indices, !morphTargets, vertices, normals, uv, weights, weightsIndex);
+  result->morphTargets = morphTargets;
+  return result;
 }
 
-MeshPtr load_mesh(const char *path, int idx)
+const aiScene *import_scene(Assimp::Importer &importer, const char *path)
 {
-
-  Assimp::Importer importer;
   importer.SetPropertyBool(AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, false);
   importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, 1.f);
 
   importer.ReadFile(path, aiPostProcessSteps::aiProcess_Triangulate | aiPostProcessSteps::aiProcess_LimitBoneWeights |
     aiPostProcessSteps::aiProcess_GenNormals | aiProcess_GlobalScale | aiProcess_FlipWindingOrder);
 
-  const aiScene* scene = importer.GetScene();
+  return importer.GetScene();
+}
+
+MeshPtr load_mesh(const char *path, int idx)
+{
+  Assimp::Importer importer;
+  const aiScene* scene = import_scene(importer, path);
   if (!scene)
   {
     debug_error("no asset in %s", path);
@@ -153,10 +179,11 @@ MeshPtr load_mesh(const char *path, int idx)
   return create_mesh(scene->mMeshes[idx]);
 }
 
-void render(const MeshPtr &mesh)
+void render(const Mesh &mesh, int draw_index)
 {
-  glBindVertexArray(mesh->vertexArrayBufferObject);
-  glDrawElementsBaseVertex(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, 0, 0);
+  gl_bind_vertex_array(mesh.vertexArrayBufferObject);
+  glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT,
+    (const void *)(mesh.firstIndex * sizeof(uint32_t)), 1, mesh.baseVertex, draw_index);
 }
 
 MeshPtr make_plane_mesh()
@@ -165,5 +192,5 @@ MeshPtr make_plane_mesh()
   std::vector<vec3> vertices = {vec3(-1,0,-1), vec3(1,0,-1), vec3(1,0,1), vec3(-1,0,1)};
   std::vector<vec3> normals(4, vec3(0,1,0));
   std::vector<vec2> uv = {vec2(0,0), vec2(1,0), vec2(1,1), vec2(0,1)};
-  return create_mesh(indices, vertices, normals, uv);
+  return create_mesh(indices, true, vertices, normals, uv);
 }
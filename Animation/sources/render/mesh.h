@@ -1,22 +1,42 @@
 #pragma once
 #include <map>
 #include <memory>
+#include <vector>
 
+struct MorphTargetSet;
 
+//static meshes share the vertex array of the geometry pool and are drawn from their offsets,
+//meshes with morph targets keep their own one
 struct Mesh
 {
   const uint32_t vertexArrayBufferObject;
   const int numIndices;
+  const int firstIndex;
+  const int baseVertex;
+  //blend shapes, nullptr for most meshes
+  std::shared_ptr<MorphTargetSet> morphTargets;
 
-  Mesh(uint32_t vertexArrayBufferObject, int numIndices) :
+  Mesh(uint32_t vertexArrayBufferObject, int numIndices, int firstIndex = 0, int baseVertex = 0) :
     vertexArrayBufferObject(vertexArrayBufferObject),
-    numIndices(numIndices)
+    numIndices(numIndices),
+    firstIndex(firstIndex),
+    baseVertex(baseVertex)
     {}
 };
 
 using MeshPtr = std::shared_ptr<Mesh>;
 
+namespace Assimp { class Importer; }
+struct aiScene;
+struct aiMesh;
+
+const aiScene *import_scene(Assimp::Importer &importer, const char *path);
+
+//bone_remap maps aiMesh bones to skeleton joints, empty keeps bone order, morph targets are imported too,
+//meshes without them go to the geometry pool
+MeshPtr create_mesh(const aiMesh *mesh, const std::vector<int> &bone_remap = {});
 MeshPtr load_mesh(const char *path, int idx);
 MeshPtr make_plane_mesh();
 
-void render(const MeshPtr &mesh);
\ No newline at end of file
+//draw_index is the base instance, it selects the DrawIndex attribute value
+void render(const Mesh &mesh, int draw_index = 0);
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "morph_targets.h"
+#include <climits>
+#include <emmintrin.h>
+#include <assimp/scene.h>
+#include <log.h>
+#include "glad/glad.h"
+#include "gl_state.h"
+
+static float quantize_deltas(const std::vector<vec3> &deltas, std::vector<int16_t> &result)
+{
+  float maxDelta = 0.f;
+  for (const vec3 &delta : deltas)
+    maxDelta = glm::max(maxDelta, glm::max(glm::abs(delta.x), glm::max(glm::abs(delta.y), glm::abs(delta.z))));
+  float scale = maxDelta / 32767.f;
+  float invScale = maxDelta > 0.f ? 1.f / scale : 0.f;
+  result.resize(deltas.size() * 4);
+  for (size_t i = 0; i < deltas.size(); i++)
+  {
+    for (int j = 0; j < 3; j++)
+      result[i * 4 + j] = int16_t(glm::round(deltas[i][j] * invScale));
+    result[i * 4 + 3] = 0;
+  }
+  return scale;
+}
+
+MorphTargetSetPtr import_morph_targets(const aiMesh *mesh, float threshold)
+{
+  if (mesh->mNumAnimMeshes == 0)
+    return nullptr;
+  auto morphTargets = std::make_shared<MorphTargetSet>();
+  int numVert = mesh->mNumVertices;
+  morphTargets->vertexCount = numVert;
+  size_t totalDeltas = 0;
+  for (unsigned i = 0; i < mesh->mNumAnimMeshes; i++)
+  {
+    const aiAnimMesh *animMesh = mesh->mAnimMeshes[i];
+    if (!animMesh->HasPositions() || (int)animMesh->mNumVertices != numVert)
+      continue;
+
+    MorphTarget &target = morphTargets->targets.emplace_back();
+    target.name = animMesh->mName.C_Str();
+    std::vector<vec3> positionDeltas, normalDeltas;
+    for (int j = 0; j < numVert; j++)
+    {
+      vec3 position = to_vec3(animMesh->mVertices[j]) - to_vec3(mesh->mVertices[j]);
+      vec3 normal = animMesh->HasNormals() && mesh->HasNormals() ?
+        to_vec3(animMesh->mNormals[j]) - to_vec3(mesh->mNormals[j]) : vec3(0.f);
+      if (length(position) <= threshold && length(normal) <= threshold)
+        continue;
+      target.vertices.push_back(j);
+      positionDeltas.push_back(position);
+      normalDeltas.push_back(normal);
+    }
+    target.positionScale = quantize_deltas(positionDeltas, target.positionDeltas);
+    target.normalScale = quantize_deltas(normalDeltas, target.normalDeltas);
+    totalDeltas += target.vertices.size();
+  }
+  debug_log("morph targets: %d targets, %.1f%% of vertices per target", (int)morphTargets->targets.size(),
+    100.f * totalDeltas / glm::max<size_t>(morphTargets->targets.size() * numVert, 1));
+  return morphTargets;
+}
+
+void init_morph_state(MorphState &state, const MorphTargetSet &morph_targets)
+{
+  int n = morph_targets.vertexCount;
+  state.positionOffsets.assign(n, vec4(0.f));
+  state.normalOffsets.assign(n, vec4(0.f));
+  state.touchedFlags.assign(n, 0);
+  state.touched.clear();
+  state.dirtyBegin = 0;
+  state.dirtyEnd = n;
+  if (!state.buffer)
+    glGenBuffers(1, &state.buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, state.buffer);
+  glBufferData(GL_ARRAY_BUFFER, 2 * n * sizeof(vec4), nullptr, GL_DYNAMIC_DRAW);
+}
+
+//sign extends int16 deltas of two vertices, scales them and adds to the offsets
+static void accumulate_deltas(const int16_t *deltas, const uint32_t *vertices, int count, float scale, vec4 *offsets)
+{
+  const __m128 s = _mm_set1_ps(scale);
+  int i = 0;
+  for (; i + 2 <= count; i += 2)
+  {
+    __m128i packed = _mm_loadu_si128((const __m128i *)(deltas + i * 4));
+    __m128 delta0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+    __m128 delta1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+    float *offset0 = &offsets[vertices[i]].x;
+    float *offset1 = &offsets[vertices[i + 1]].x;
+    _mm_storeu_ps(offset0, _mm_add_ps(_mm_loadu_ps(offset0), _mm_mul_ps(delta0, s)));
+    _mm_storeu_ps(offset1, _mm_add_ps(_mm_loadu_ps(offset1), _mm_mul_ps(delta1, s)));
+  }
+  if (i < count)
+  {
+    __m128i packed = _mm_loadl_epi64((const __m128i *)(deltas + i * 4));
+    __m128 delta = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+    float *offset = &offsets[vertices[i]].x;
+    _mm_storeu_ps(offset, _mm_add_ps(_mm_loadu_ps(offset), _mm_mul_ps(delta, s)));
+  }
+}
+
+int accumulate_morph_targets(const MorphTargetSet &morph_targets, const float *weights, float epsilon, MorphState &state)
+{
+  int dirtyBegin = INT_MAX, dirtyEnd = 0;
+  for (uint32_t vertex : state.touched)
+  {
+    state.positionOffsets[vertex] = vec4(0.f);
+    state.normalOffsets[vertex] = vec4(0.f);
+    state.touchedFlags[vertex] = 0;
+    dirtyBegin = glm::min(dirtyBegin, int(vertex));
+    dirtyEnd = glm::max(dirtyEnd, int(vertex) + 1);
+  }
+  state.touched.clear();
+
+  for (int i = 0, n = morph_targets.targets.size(); i < n; i++)
+  {
+    if (glm::abs(weights[i]) < epsilon)
+      continue;
+    const MorphTarget &target = morph_targets.targets[i];
+    int count = target.vertices.size();
+    for (uint32_t vertex : target.vertices)
+      if (!state.touchedFlags[vertex])
+      {
+        state.touchedFlags[vertex] = 1;
+        state.touched.push_back(vertex);
+      }
+    if (count > 0)
+    {
+      dirtyBegin = glm::min(dirtyBegin, int(target.vertices.front()));
+      dirtyEnd = glm::max(dirtyEnd, int(target.vertices.back()) + 1);
+    }
+    accumulate_deltas(target.positionDeltas.data(), target.vertices.data(), count, target.positionScale * weights[i], state.positionOffsets.data());
+    accumulate_deltas(target.normalDeltas.data(), target.vertices.data(), count, target.normalScale * weights[i], state.normalOffsets.data());
+  }
+  state.dirtyBegin = glm::min(state.dirtyBegin, dirtyBegin);
+  state.dirtyEnd = glm::max(state.dirtyEnd, dirtyEnd);
+  return state.touched.size();
+}
+
+void upload_morph_state(MorphState &state)
+{
+  if (state.dirtyBegin >= state.dirtyEnd)
+    return;
+  size_t offset = state.dirtyBegin * sizeof(vec4);
+  size_t size = (state.dirtyEnd - state.dirtyBegin) * sizeof(vec4);
+  size_t normalsOffset = state.positionOffsets.size() * sizeof(vec4);
+  glBindBuffer(GL_ARRAY_BUFFER, state.buffer);
+  glBufferSubData(GL_ARRAY_BUFFER, offset, size, &state.positionOffsets[state.dirtyBegin]);
+  glBufferSubData(GL_ARRAY_BUFFER, normalsOffset + offset, size, &state.normalOffsets[state.dirtyBegin]);
+  state.dirtyBegin = INT_MAX;
+  state.dirtyEnd = 0;
+}
+
+void render(const Mesh &mesh, const MorphState &morph, int draw_index)
+{
+  //the attributes stay disabled for other draws, so shaders read zero offsets
+  gl_bind_vertex_array(mesh.vertexArrayBufferObject);
+  glBindBuffer(GL_ARRAY_BUFFER, morph.buffer);
+  glEnableVertexAttribArray(MorphPositionLocation);
+  glVertexAttribPointer(MorphPositionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(vec4), 0);
+  glEnableVertexAttribArray(MorphNormalLocation);
+  glVertexAttribPointer(MorphNormalLocation, 3, GL_FLOAT, GL_FALSE, sizeof(vec4), (const void *)(morph.positionOffsets.size() * sizeof(vec4)));
+  glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT,
+    (const void *)(mesh.firstIndex * sizeof(uint32_t)), 1, mesh.baseVertex, draw_index);
+  glDisableVertexAttribArray(MorphPositionLocation);
+  glDisableVertexAttribArray(MorphNormalLocation);
+}
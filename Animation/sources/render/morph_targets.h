@@ -0,0 +1,58 @@
+#pragma once
+#include <3dmath.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+//attribute locations of the morph offsets in character_vs.glsl
+constexpr int MorphPositionLocation = 5;
+constexpr int MorphNormalLocation = 6;
+
+//only vertices which move, deltas are quantized to int16 with per target scales,
+//4 values per vertex (w is zero) so one simd register holds two vertices
+struct MorphTarget
+{
+  std::string name;
+  std::vector<uint32_t> vertices;
+  std::vector<int16_t> positionDeltas;
+  std::vector<int16_t> normalDeltas;
+  float positionScale = 0.f;
+  float normalScale = 0.f;
+};
+
+struct MorphTargetSet
+{
+  int vertexCount = 0;
+  std::vector<MorphTarget> targets;
+};
+
+using MorphTargetSetPtr = std::shared_ptr<MorphTargetSet>;
+
+//blend shapes from aiMesh::mAnimMeshes, nullptr if the mesh doesn't have them
+MorphTargetSetPtr import_morph_targets(const aiMesh *mesh, float threshold = 1e-5f);
+
+//per character offsets, arrays are dense but only touched vertices are written and cleared
+struct MorphState
+{
+  std::vector<vec4> positionOffsets;
+  std::vector<vec4> normalOffsets;
+  std::vector<uint32_t> touched;
+  std::vector<uint8_t> touchedFlags;
+  //vertices changed since the last upload
+  int dirtyBegin = 0;
+  int dirtyEnd = 0;
+  //position offsets followed by normal offsets
+  uint32_t buffer = 0;
+};
+
+void init_morph_state(MorphState &state, const MorphTargetSet &morph_targets);
+
+//targets with weights below epsilon are skipped, returns the number of touched vertices
+int accumulate_morph_targets(const MorphTargetSet &morph_targets, const float *weights, float epsilon, MorphState &state);
+
+//uploads only the range of vertices changed by the last accumulation
+void upload_morph_state(MorphState &state);
+
+void render(const Mesh &mesh, const MorphState &morph, int draw_index = 0);
@@ -0,0 +1,174 @@
+#include "render_queue.h"
+#include "morph_targets.h"
+#include "gl_state.h"
+#include "geometry_pool.h"
+#include <cstring>
+
+uint64_t make_sort_key(RenderPass pass, uint32_t program, uint32_t material, uint32_t texture, uint32_t mesh, float depth)
+{
+  uint32_t depthBits = uint32_t(glm::clamp(depth, 0.f, 1.f) * 0xFFFF);
+  if (pass == RenderPass::Transparent)
+    depthBits = 0xFFFF - depthBits;
+  return uint64_t(pass) << 62 |
+    uint64_t(program & 0x3FF) << 52 |
+    uint64_t(material & 0xFFF) << 40 |
+    uint64_t(texture & 0xFFF) << 28 |
+    uint64_t(mesh & 0xFFF) << 16 |
+    depthBits;
+}
+
+void clear_render_queue(RenderQueue &queue)
+{
+  queue.items.clear();
+  queue.keys.clear();
+  queue.order.clear();
+  if (!queue.drawData.buffer)
+    create_ring_buffer(queue.drawData, GL_SHADER_STORAGE_BUFFER, RenderQueueDrawDataSize, sizeof(mat4));
+  begin_ring_buffer_frame(queue.drawData);
+}
+
+void add_draw_item(
+  RenderQueue &queue,
+  RenderPass pass,
+  const MeshPtr &mesh,
+  const MaterialPtr &material,
+  const mat4 &transform,
+  const mat4 *palette,
+  int palette_size,
+  float depth,
+  const MorphState *morph)
+{
+  if ((int)queue.items.size() >= MaxDrawsPerFrame)
+    return;
+  RingAllocation data = allocate_ring_buffer(queue.drawData, (1 + palette_size) * sizeof(mat4));
+  if (!data.data)
+    return;
+  memcpy(data.data, &transform, sizeof(mat4));
+  memcpy(data.data + sizeof(mat4), palette, palette_size * sizeof(mat4));
+  queue.items.push_back(DrawItem{mesh.get(), material.get(), morph, int(data.offset), int(data.size)});
+  uint32_t program = material->get_shader().program;
+  queue.keys.push_back(make_sort_key(pass, program, material->id, material->main_texture(), mesh->vertexArrayBufferObject, depth));
+}
+
+void sort_render_queue(RenderQueue &queue)
+{
+  int n = queue.keys.size();
+  std::vector<uint32_t> &order = queue.order;
+  order.resize(n);
+  for (int i = 0; i < n; i++)
+    order[i] = i;
+  if (n == 0)
+    return;
+  std::vector<uint32_t> buffer(n);
+  const uint64_t *keys = queue.keys.data();
+  for (int shift = 0; shift < 64; shift += 8)
+  {
+    int histogram[256] = {};
+    for (int i = 0; i < n; i++)
+      histogram[keys[i] >> shift & 0xFF]++;
+    if (histogram[keys[0] >> shift & 0xFF] == n)
+      continue;
+    int offset = 0;
+    for (int &count : histogram)
+    {
+      int c = count;
+      count = offset;
+      offset += c;
+    }
+    //stable, so the order of the previous bytes is kept
+    for (int i = 0; i < n; i++)
+    {
+      uint32_t item = order[i];
+      buffer[histogram[keys[item] >> shift & 0xFF]++] = item;
+    }
+    order.swap(buffer);
+  }
+}
+
+//glMultiDrawElementsIndirect command layout
+struct DrawElementsCommand
+{
+  uint32_t count;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  uint32_t baseInstance;
+};
+
+void submit_render_queue(RenderQueue &queue)
+{
+  RenderStats &stats = queue.stats;
+  stats = RenderStats();
+  RingBuffer &ring = queue.drawData;
+  int n = queue.order.size();
+  //the base instance of a draw is its item index, the DrawIndex attribute reads it back
+  //in the shader to find the first matrix of the item
+  RingAllocation firstMatrices = allocate_ring_buffer(ring, n * sizeof(uint32_t));
+  RingAllocation commands = allocate_ring_buffer(ring, n * sizeof(DrawElementsCommand));
+  if (n > 0 && firstMatrices.data && commands.data)
+  {
+    GLintptr frameOffset = ring_buffer_frame_offset(ring);
+    uint32_t *firstMatrix = (uint32_t *)firstMatrices.data;
+    for (int i = 0; i < n; i++)
+      firstMatrix[i] = (queue.items[i].dataOffset - frameOffset) / sizeof(mat4);
+    gl_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, DrawDataBinding, ring.buffer, frameOffset, ring.frameSize);
+    gl_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, DrawFirstMatrixBinding, ring.buffer, firstMatrices.offset, firstMatrices.size);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer);
+
+    DrawElementsCommand *command = (DrawElementsCommand *)commands.data;
+    int batchBegin = 0, commandCount = 0;
+    auto flush = [&]()
+    {
+      if (commandCount == batchBegin)
+        return;
+      const void *offset = (const void *)(commands.offset + batchBegin * sizeof(DrawElementsCommand));
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, commandCount - batchBegin, 0);
+      batchBegin = commandCount;
+      stats.drawCalls++;
+    };
+
+    uint32_t program = 0;
+    const Material *material = nullptr;
+    uint32_t vertexArray = 0;
+    for (uint32_t index : queue.order)
+    {
+      const DrawItem &item = queue.items[index];
+      const Mesh &mesh = *item.mesh;
+      const Shader &shader = item.material->get_shader();
+      if (shader.program != program || item.material != material || mesh.vertexArrayBufferObject != vertexArray || item.morph)
+        flush();
+      if (shader.program != program)
+      {
+        shader.use();
+        program = shader.program;
+        material = nullptr;
+        stats.programBinds++;
+      }
+      if (item.material != material)
+      {
+        item.material->bind_uniforms_to_shader();
+        material = item.material;
+        stats.materialBinds++;
+      }
+      if (mesh.vertexArrayBufferObject != vertexArray)
+      {
+        gl_bind_vertex_array(mesh.vertexArrayBufferObject);
+        vertexArray = mesh.vertexArrayBufferObject;
+        stats.meshBinds++;
+      }
+      //morph offsets are bound per character, so these meshes are drawn one by one
+      if (item.morph)
+      {
+        render(mesh, *item.morph, index);
+        stats.drawCalls++;
+      }
+      else
+        command[commandCount++] = DrawElementsCommand{uint32_t(mesh.numIndices), 1, uint32_t(mesh.firstIndex), mesh.baseVertex, index};
+      stats.draws++;
+    }
+    flush();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  stats.drawDataBytes = ring.used;
+  end_ring_buffer_frame(ring);
+}
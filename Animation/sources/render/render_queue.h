@@ -0,0 +1,79 @@
+#pragma once
+#include "material.h"
+#include "mesh.h"
+#include "ring_buffer.h"
+#include <cstdint>
+
+struct MorphState;
+
+enum class RenderPass
+{
+  Opaque,
+  Transparent
+};
+
+//storage buffer bindings of the DrawData and DrawFirstMatrix blocks in character_vs.glsl
+constexpr int DrawDataBinding = 2;
+constexpr int DrawFirstMatrixBinding = 3;
+//initial size of a ring buffer frame region, it grows when a frame doesn't fit
+constexpr int RenderQueueDrawDataSize = 1 << 20;
+
+//one draw of the frame, the transform and the bone palette are written to the ring buffer
+struct DrawItem
+{
+  const Mesh *mesh;
+  const Material *material;
+  const MorphState *morph;
+  int dataOffset;
+  int dataSize;
+};
+
+struct RenderStats
+{
+  int draws = 0;
+  //glMultiDrawElementsIndirect calls and single draws of meshes with morph targets
+  int drawCalls = 0;
+  int programBinds = 0;
+  int materialBinds = 0;
+  int meshBinds = 0;
+  int drawDataBytes = 0;
+};
+
+struct RenderQueue
+{
+  std::vector<DrawItem> items;
+  std::vector<uint64_t> keys;
+  //transform followed by the bone palette of every item, then the first matrix of
+  //every item and indirect commands written at submission
+  RingBuffer drawData;
+  //item indices in the submission order
+  std::vector<uint32_t> order;
+  RenderStats stats;
+};
+
+//from the high bits: pass, shader, material, texture, mesh, depth, so draws with the same state are adjacent,
+//opaque draws are front to back and transparent ones back to front inside their state
+uint64_t make_sort_key(RenderPass pass, uint32_t program, uint32_t material, uint32_t texture, uint32_t mesh, float depth);
+
+//starts the frame of the draw data ring buffer, creates it on the first call
+void clear_render_queue(RenderQueue &queue);
+
+//depth is the view distance divided by the far plane, the item is dropped if the
+//draw data doesn't fit in the ring buffer this frame
+void add_draw_item(
+  RenderQueue &queue,
+  RenderPass pass,
+  const MeshPtr &mesh,
+  const MaterialPtr &material,
+  const mat4 &transform,
+  const mat4 *palette,
+  int palette_size,
+  float depth,
+  const MorphState *morph = nullptr);
+
+//lsd radix sort of the keys, byte passes where all keys are equal are skipped
+void sort_render_queue(RenderQueue &queue);
+
+//binds programs, materials and meshes only when they change between adjacent items, runs of
+//items with the same state are one glMultiDrawElementsIndirect, fences the draw data after the last draw
+void submit_render_queue(RenderQueue &queue);
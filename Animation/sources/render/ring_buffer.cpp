@@ -0,0 +1,97 @@
+#include "ring_buffer.h"
+#include <log.h>
+#include <algorithm>
+
+void create_ring_buffer(RingBuffer &ring, GLenum target, int frame_size, int min_alignment)
+{
+  GLint alignment = 1;
+  glGetIntegerv(target == GL_SHADER_STORAGE_BUFFER ? GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT : GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  ring.target = target;
+  ring.alignment = std::max(alignment, min_alignment);
+  ring.frameSize = (frame_size + ring.alignment - 1) / ring.alignment * ring.alignment;
+  ring.frame = 0;
+  ring.used = ring.requested = 0;
+
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLsizeiptr size = GLsizeiptr(ring.frameSize) * RingBufferFrames;
+  glGenBuffers(1, &ring.buffer);
+  glBindBuffer(target, ring.buffer);
+  glBufferStorage(target, size, nullptr, flags);
+  ring.data = (uint8_t *)glMapBufferRange(target, 0, size, flags);
+  if (!ring.data)
+    debug_error("ring buffer: can't map %d bytes", (int)size);
+}
+
+void destroy_ring_buffer(RingBuffer &ring)
+{
+  for (GLsync &fence : ring.fences)
+    if (fence)
+    {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  if (ring.buffer)
+  {
+    glBindBuffer(ring.target, ring.buffer);
+    glUnmapBuffer(ring.target);
+    //the driver keeps the storage alive until queued draws finish
+    glDeleteBuffers(1, &ring.buffer);
+  }
+  ring.buffer = 0;
+  ring.data = nullptr;
+}
+
+void begin_ring_buffer_frame(RingBuffer &ring)
+{
+  if (ring.requested > ring.frameSize)
+  {
+    int frameSize = std::max(ring.requested, ring.frameSize * 2);
+    debug_log("ring buffer: %d bytes requested, frame grows to %d", ring.requested, frameSize);
+    GLenum target = ring.target;
+    int minAlignment = ring.alignment;
+    destroy_ring_buffer(ring);
+    create_ring_buffer(ring, target, frameSize, minAlignment);
+  }
+  else
+    ring.frame = (ring.frame + 1) % RingBufferFrames;
+  ring.used = ring.requested = 0;
+
+  GLsync &fence = ring.fences[ring.frame];
+  if (!fence)
+    return;
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+  {
+    ring.stalls++;
+    const GLuint64 timeout = 1000000000;
+    while (status == GL_TIMEOUT_EXPIRED)
+      status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+RingAllocation allocate_ring_buffer(RingBuffer &ring, int size)
+{
+  int offset = ring.used;
+  int end = offset + (size + ring.alignment - 1) / ring.alignment * ring.alignment;
+  ring.requested += end - offset;
+  if (!ring.data || end > ring.frameSize)
+    return RingAllocation{nullptr, 0, 0};
+  ring.used = end;
+  GLintptr bufferOffset = GLintptr(ring.frame) * ring.frameSize + offset;
+  return RingAllocation{ring.data + bufferOffset, bufferOffset, size};
+}
+
+GLintptr ring_buffer_frame_offset(const RingBuffer &ring)
+{
+  return GLintptr(ring.frame) * ring.frameSize;
+}
+
+void end_ring_buffer_frame(RingBuffer &ring)
+{
+  GLsync &fence = ring.fences[ring.frame];
+  if (fence)
+    glDeleteSync(fence);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "glad/glad.h"
+#include <cstdint>
+
+//frames the cpu may write ahead of the gpu
+constexpr int RingBufferFrames = 3;
+
+//persistently mapped coherent buffer split in RingBufferFrames regions, the cpu writes the region
+//of the current frame while the gpu reads the previous ones, a fence per region tells when it's free
+struct RingBuffer
+{
+  GLuint buffer = 0;
+  GLenum target = 0;
+  uint8_t *data = nullptr;
+  int frameSize = 0;
+  int alignment = 0;
+  int frame = 0;
+  //bytes used in the current frame
+  int used = 0;
+  //bytes requested in the current frame, more than frameSize if allocations failed
+  int requested = 0;
+  GLsync fences[RingBufferFrames] = {};
+  //frames which had to wait for the gpu
+  int stalls = 0;
+};
+
+struct RingAllocation
+{
+  //nullptr if the frame region is full
+  uint8_t *data;
+  //offset from the start of the buffer, for glBindBufferRange
+  GLintptr offset;
+  GLsizeiptr size;
+};
+
+//target selects the offset alignment, GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER,
+//min_alignment is a power of two for arrays indexed from the start of the frame region
+void create_ring_buffer(RingBuffer &ring, GLenum target, int frame_size, int min_alignment = 1);
+void destroy_ring_buffer(RingBuffer &ring);
+
+//moves to the next region and waits until the gpu has finished with it, a ring which
+//overflowed in the last frame is recreated with a larger region
+void begin_ring_buffer_frame(RingBuffer &ring);
+RingAllocation allocate_ring_buffer(RingBuffer &ring, int size);
+//offset of the current frame region from the start of the buffer
+GLintptr ring_buffer_frame_offset(const RingBuffer &ring);
+//fences the region after the draws reading it are issued
+void end_ring_buffer_frame(RingBuffer &ring);
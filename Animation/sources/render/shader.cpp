@@ -1,14 +1,62 @@
 #include "shader.h"
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include "log.h"
 #include "glad/glad.h"
 #include <filesystem>
 #include <array>
 #include <vector>
 #include <fstream>
+#include <cstring>
+#include <cctype>
 
 
+struct UniformNames
+{
+  std::vector<std::string> names;
+  std::unordered_map<std::string, int> ids;
+};
+
+//function static, ids are made by static initializers of other files
+static UniformNames &uniform_names()
+{
+  static UniformNames names;
+  return names;
+}
+
+UniformId get_uniform_id(const char *name)
+{
+  UniformNames &names = uniform_names();
+  auto it = names.ids.find(name);
+  if (it != names.ids.end())
+    return UniformId{it->second};
+  int index = names.names.size();
+  names.names.emplace_back(name);
+  names.ids.emplace(name, index);
+  return UniformId{index};
+}
+
+const std::string &get_uniform_name(UniformId id)
+{
+  return uniform_names().names[id.index];
+}
+
+static bool is_sampler_type(GLenum type)
+{
+  switch (type)
+  {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+      return true;
+    default:
+      return false;
+  }
+}
+
 static void read_shader_info(Shader &shader)
 {
   GLuint program = shader.program;
@@ -18,7 +66,12 @@ static void read_shader_info(Shader &shader)
   GLchar name[bufSize];
   GLsizei length;
   shader.uniforms.clear();
+  GLuint materialBlock = glGetUniformBlockIndex(program, "MaterialData");
+  shader.materialDataSize = 0;
+  if (materialBlock != GL_INVALID_INDEX)
+    glGetActiveUniformBlockiv(program, materialBlock, GL_UNIFORM_BLOCK_DATA_SIZE, &shader.materialDataSize);
   glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  int samplerUnits = 0;
   for (int i = 0; i < count; i++)
   {
     GLenum type;
@@ -26,8 +79,44 @@ static void read_shader_info(Shader &shader)
     glGetActiveUniform(program, (GLuint)i, bufSize, &length, &size, &type, name);
     //debug_log("uniform %s #%d Type: %u Name: %s", shader.name.c_str(), i, type, name);
 
+    GLuint index = i;
+    GLint block, offset;
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+    int materialOffset = materialBlock != GL_INVALID_INDEX && block == (GLint)materialBlock ? offset : -1;
+
     GLint shaderLocation = glGetUniformLocation(program, name);
-    shader.uniforms.emplace_back(ShaderUniform{std::string(name), type, shaderLocation});
+    //units follow the order of active samplers, arrays take consecutive ones
+    int samplerUnit = -1;
+    if (is_sampler_type(type) && shaderLocation >= 0)
+    {
+      samplerUnit = samplerUnits;
+      std::vector<GLint> units(size);
+      for (GLint j = 0; j < size; j++)
+        units[j] = samplerUnit + j;
+      glProgramUniform1iv(program, shaderLocation, size, units.data());
+      samplerUnits += size;
+    }
+    shader.uniforms.emplace_back(ShaderUniform{std::string(name), type, shaderLocation, materialOffset, samplerUnit});
+  }
+
+  //arrays are reported as "name[0]" but set by the name
+  shader.locations.clear();
+  shader.materialOffsets.clear();
+  shader.samplerUnits.clear();
+  for (const ShaderUniform &uniform : shader.uniforms)
+  {
+    std::string baseName = uniform.name.substr(0, uniform.name.find('['));
+    UniformId id = get_uniform_id(baseName.c_str());
+    if (id.index >= (int)shader.locations.size())
+    {
+      shader.locations.resize(id.index + 1, -1);
+      shader.materialOffsets.resize(id.index + 1, -1);
+      shader.samplerUnits.resize(id.index + 1, -1);
+    }
+    shader.locations[id.index] = uniform.shaderLocation;
+    shader.materialOffsets[id.index] = uniform.materialOffset;
+    shader.samplerUnits[id.index] = uniform.samplerUnit;
   }
 }
 
@@ -62,6 +151,7 @@ static bool compile_shader(const char *shaderName, const std::vector<ShaderInfo>
 
 
   program = glCreateProgram();
+  glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   for (GLuint shaderProg : compiled_shaders)
     glAttachShader(program, shaderProg);
 
@@ -88,6 +178,121 @@ static std::string read_file(const char *path)
   return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
 }
 
+//linked programs are stored in the driver format, a new driver or changed sources make a new key
+static const char *ProgramCacheFolder = "Builds/shader_cache";
+static const uint32_t ProgramCacheMagic = 0x42505348;
+
+struct ProgramCacheHeader
+{
+  uint32_t magic;
+  uint32_t format;
+  uint64_t key;
+  uint32_t size;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  return hash;
+}
+
+static uint64_t fnv1a(uint64_t hash, const char *text)
+{
+  //the terminator separates adjacent strings
+  return fnv1a(hash, text, strlen(text) + 1);
+}
+
+//shaders don't have defines yet, they would be hashed with the sources
+static uint64_t program_cache_key(const std::vector<ShaderInfo> &shaders)
+{
+  uint64_t key = 0xCBF29CE484222325ull;
+  for (GLenum driverString : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+  {
+    const char *text = (const char *)glGetString(driverString);
+    key = fnv1a(key, text ? text : "");
+  }
+  for (const ShaderInfo &shader : shaders)
+  {
+    key = fnv1a(key, &shader.shaderType, sizeof(shader.shaderType));
+    key = fnv1a(key, shader.sources.c_str());
+  }
+  return key;
+}
+
+static std::filesystem::path program_cache_path(const char *name, uint64_t key)
+{
+  char fileName[256];
+  snprintf(fileName, sizeof(fileName), "%s_%016llx.bin", name, (unsigned long long)key);
+  return std::filesystem::path(ProgramCacheFolder) / fileName;
+}
+
+//exactly <name>_<16 hex digits>.bin, so "character" doesn't match "character_shadow" binaries
+static bool is_program_cache_file(const std::string &file_name, const char *name)
+{
+  size_t nameLength = strlen(name);
+  const size_t keyLength = 16;
+  const char *extension = ".bin";
+  if (file_name.size() != nameLength + 1 + keyLength + strlen(extension) ||
+      file_name.compare(0, nameLength, name) != 0 || file_name[nameLength] != '_' ||
+      file_name.compare(nameLength + 1 + keyLength, std::string::npos, extension) != 0)
+    return false;
+  for (size_t i = nameLength + 1; i < nameLength + 1 + keyLength; i++)
+    if (!isxdigit((unsigned char)file_name[i]))
+      return false;
+  return true;
+}
+
+static bool load_program_binary(const std::filesystem::path &path, uint64_t key, GLuint &program)
+{
+  std::ifstream file(path, std::ios::binary);
+  ProgramCacheHeader header;
+  if (!file.read((char *)&header, sizeof(header)) || header.magic != ProgramCacheMagic || header.key != key)
+    return false;
+  std::vector<char> binary(header.size);
+  if (!file.read(binary.data(), binary.size()))
+    return false;
+
+  //the driver may reject binaries of other versions even with the same strings
+  program = glCreateProgram();
+  glProgramBinary(program, header.format, binary.data(), binary.size());
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    glDeleteProgram(program);
+    return false;
+  }
+  return true;
+}
+
+static void save_program_binary(const char *name, const std::filesystem::path &path, uint64_t key, GLuint program)
+{
+  GLint formats = 0, size = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (formats == 0 || size <= 0)
+    return;
+  std::vector<char> binary(size);
+  GLenum format;
+  glGetProgramBinary(program, size, &size, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(ProgramCacheFolder, error);
+  //binaries of older sources of the same program are never loaded again
+  for (const auto &entry : std::filesystem::directory_iterator(ProgramCacheFolder, error))
+    if (entry.path() != path && is_program_cache_file(entry.path().filename().string(), name))
+      std::filesystem::remove(entry.path(), error);
+
+  std::ofstream file(path, std::ios::binary);
+  ProgramCacheHeader header = {ProgramCacheMagic, format, key, uint32_t(size)};
+  file.write((const char *)&header, sizeof(header));
+  file.write(binary.data(), size);
+  if (!file)
+    debug_error("can't write program binary %s", path.string().c_str());
+}
+
 static bool compile_shader(const char *name, const Shader::ShaderSources &sources, GLuint &program)
 {
   std::vector<ShaderInfo> shaderCode;
@@ -96,7 +301,18 @@ static bool compile_shader(const char *name, const Shader::ShaderSources &source
   {
     shaderCode.emplace_back(ShaderInfo{shaderType, path, read_file(path.c_str())});
   }
-  return compile_shader(name, shaderCode, program);
+
+  uint64_t key = program_cache_key(shaderCode);
+  std::filesystem::path cachePath = program_cache_path(name, key);
+  if (load_program_binary(cachePath, key, program))
+  {
+    debug_log("shader %s loaded from %s", name, cachePath.string().c_str());
+    return true;
+  }
+  if (!compile_shader(name, shaderCode, program))
+    return false;
+  save_program_binary(name, cachePath, key, program);
+  return true;
 }
 
 static std::vector<ShaderPtr> shaderList;
@@ -4,15 +4,33 @@
 #include <string>
 #include <memory>
 #include "glad/glad.h"
+#include "gl_state.h"
 
 
+//material constants are read from this std140 block, see Material
+constexpr int MaterialDataBinding = 1;
+
 struct ShaderUniform
 {
   std::string name;
   unsigned int type;
   int shaderLocation;
+  //byte offset in the MaterialData block, -1 for other uniforms
+  int materialOffset;
+  //first texture unit of a sampler, -1 for other uniforms
+  int samplerUnit;
+};
+
+//uniform name interned once, indexes the location table of every shader
+struct UniformId
+{
+  int index;
 };
 
+//ids of the same name are equal, keep them in statics instead of passing strings every draw
+UniformId get_uniform_id(const char *name);
+const std::string &get_uniform_name(UniformId id);
+
 
 class Shader
 {
@@ -24,6 +42,14 @@ public:
 	const ShaderSources shaderSources; //for hotreload
 	GLuint program;
   std::vector<ShaderUniform> uniforms;
+	//location of every interned uniform id, -1 if the shader doesn't have it, rebuilt after every link
+	std::vector<int> locations;
+	//the same table for offsets in the MaterialData block
+	std::vector<int> materialOffsets;
+	//and for texture units, every sampler has a fixed unit set once after link, so materials sharing
+	//the program bind their textures to the same units
+	std::vector<int> samplerUnits;
+	int materialDataSize = 0;
 
 	Shader(const std::string &shader_name, GLuint shader_program, ShaderSources sources):
 		name(shader_name),
@@ -33,16 +59,34 @@ public:
 
 	void use() const
 	{
-		glUseProgram(program);
+		gl_use_program(program);
 	}
 
-	int get_uniform_location(const char *name)
+	//names of active uniforms are interned at link, so ids made later are never in the table
+	int get_uniform_location(UniformId id) const
+	{
+		return id.index < (int)locations.size() ? locations[id.index] : -1;
+	}
+	int get_material_offset(UniformId id) const
+	{
+		return id.index < (int)materialOffsets.size() ? materialOffsets[id.index] : -1;
+	}
+	int get_sampler_unit(UniformId id) const
+	{
+		return id.index < (int)samplerUnits.size() ? samplerUnits[id.index] : -1;
+	}
+	//the driver lookup resolves element names like "Bones[3]" and doesn't intern unknown names
+	int get_uniform_location(const char *name) const
 	{
 		return glGetUniformLocation(program, name);
 	}
 	void set_mat3x3(const char*name, const mat3 &matrix, bool transpose = false) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(program, name), 1, transpose, glm::value_ptr(matrix));
+		set_mat3x3(get_uniform_location(name), matrix, transpose);
+	}
+	void set_mat3x3(UniformId id, const mat3 &matrix, bool transpose = false) const
+	{
+		set_mat3x3(get_uniform_location(id), matrix, transpose);
 	}
 	void set_mat3x3(int uniform_location, const mat3 &matrix, bool transpose = false) const
 	{
@@ -51,16 +95,36 @@ public:
 
 	void set_mat4x4(const char *name, const mat4 matrix, bool transpose = false) const
 	{
-		set_mat4x4(glGetUniformLocation(program, name), matrix, transpose);
+		set_mat4x4(get_uniform_location(name), matrix, transpose);
+	}
+	void set_mat4x4(UniformId id, const mat4 matrix, bool transpose = false) const
+	{
+		set_mat4x4(get_uniform_location(id), matrix, transpose);
 	}
 	void set_mat4x4(int uniform_location, const mat4 matrix, bool transpose = false) const
 	{
 		glUniformMatrix4fv(uniform_location, 1, transpose, glm::value_ptr(matrix));
 	}
+	void set_mat4x4(const char *name, const mat4 *matrices, int count, bool transpose = false) const
+	{
+		set_mat4x4(get_uniform_location(name), matrices, count, transpose);
+	}
+	void set_mat4x4(UniformId id, const mat4 *matrices, int count, bool transpose = false) const
+	{
+		set_mat4x4(get_uniform_location(id), matrices, count, transpose);
+	}
+	void set_mat4x4(int uniform_location, const mat4 *matrices, int count, bool transpose = false) const
+	{
+		glUniformMatrix4fv(uniform_location, count, transpose, glm::value_ptr(matrices[0]));
+	}
 
 	void set_float(const char *name, const float &v) const
 	{
-		set_float(glGetUniformLocation(program, name), v);
+		set_float(get_uniform_location(name), v);
+  }
+	void set_float(UniformId id, const float &v) const
+	{
+		set_float(get_uniform_location(id), v);
   }
 	void set_float(int uniform_location, const float &v) const
 	{
@@ -68,7 +132,11 @@ public:
   }
 	void set_int(const char *name, int v) const
 	{
-		set_int(glGetUniformLocation(program, name), v);
+		set_int(get_uniform_location(name), v);
+  }
+	void set_int(UniformId id, int v) const
+	{
+		set_int(get_uniform_location(id), v);
   }
 	void set_int(int uniform_location, int v) const
 	{
@@ -77,7 +145,11 @@ public:
 
 	void set_vec2(const char*name, const vec2 &v) const
 	{
-		set_vec2(glGetUniformLocation(program, name), v);
+		set_vec2(get_uniform_location(name), v);
+  }
+	void set_vec2(UniformId id, const vec2 &v) const
+	{
+		set_vec2(get_uniform_location(id), v);
   }
 	void set_vec2(int uniform_location, const vec2 &v) const
 	{
@@ -86,7 +158,11 @@ public:
 
 	void set_vec3(const char*name, const vec3 &v) const
 	{
-		set_vec3(glGetUniformLocation(program, name), v);
+		set_vec3(get_uniform_location(name), v);
+  }
+	void set_vec3(UniformId id, const vec3 &v) const
+	{
+		set_vec3(get_uniform_location(id), v);
   }
 	void set_vec3(int uniform_location, const vec3 &v) const
 	{
@@ -95,7 +171,11 @@ public:
 
 	void set_vec4(const char*name, const vec4 &v) const
 	{
-		set_vec4(glGetUniformLocation(program, name), v);
+		set_vec4(get_uniform_location(name), v);
+  }
+	void set_vec4(UniformId id, const vec4 &v) const
+	{
+		set_vec4(get_uniform_location(id), v);
   }
 	void set_vec4(int uniform_location, const vec4 &v) const
 	{
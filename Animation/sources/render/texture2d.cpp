@@ -1,5 +1,6 @@
 #include "texture2d.h"
 #include "glad/glad.h"
+#include "gl_state.h"
 #include <cassert>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
@@ -11,7 +12,7 @@ Texture2DPtr create_texture(const unsigned char *image, int w, int h, int ch)
   auto texture = std::make_shared<Texture2D>(textureObject);
   GLuint textureType = GL_TEXTURE_2D;
 
-  glBindTexture(textureType, textureObject);
+  gl_bind_texture(0, textureType, textureObject);
 
   if (ch == 4)
     glTexImage2D(textureType, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
@@ -34,7 +35,7 @@ Texture2DPtr create_texture(const unsigned char *image, int w, int h, int ch)
     glTexParameteri(textureType, GL_TEXTURE_MIN_FILTER, minMagixelFormat);
     glTexParameteri(textureType, GL_TEXTURE_MAG_FILTER, minMagixelFormat);
   }
-  glBindTexture(textureType, 0);
+  gl_bind_texture(0, textureType, 0);
 
   return texture;
 }
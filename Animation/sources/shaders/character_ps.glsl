@@ -1,4 +1,4 @@
-#version 330
+#version 430
 
 struct VsOutput {
   vec3 EyespaceNormal;
@@ -6,10 +6,21 @@ struct VsOutput {
   vec2 UV;
 };
 
-uniform vec3 CameraPosition;
-uniform vec3 LightDirection;
-uniform vec3 AmbientLight;
-uniform vec3 SunLight;
+layout(std140, binding = 0) uniform GlobalRenderData
+{
+  mat4 ViewProjection;
+  vec3 CameraPosition;
+  vec3 LightDirection;
+  vec3 AmbientLight;
+  vec3 SunLight;
+};
+
+//per material constants, see material.h
+layout(std140, binding = 1) uniform MaterialData
+{
+  float Shininess;
+  float Metallness;
+};
 
 in VsOutput vsOutput;
 out vec4 FragColor;
@@ -34,9 +45,7 @@ vec3 LightedColor(
 }
 
 void main() {
-  float shininess = 1.3;
-  float metallness = 0.4;
   vec3 color = texture(mainTex, vsOutput.UV).rgb;
-  color = LightedColor(color, shininess, metallness, vsOutput.WorldPosition, vsOutput.EyespaceNormal, LightDirection, CameraPosition);
+  color = LightedColor(color, Shininess, Metallness, vsOutput.WorldPosition, vsOutput.EyespaceNormal, LightDirection, CameraPosition);
   FragColor = vec4(color, 1.0);
 }
\ No newline at end of file
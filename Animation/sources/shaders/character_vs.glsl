@@ -1,4 +1,4 @@
-#version 330
+#version 430
 
 struct VsOutput {
   vec3 EyespaceNormal;
@@ -6,21 +6,53 @@ struct VsOutput {
   vec2 UV;
 };
 
-uniform mat4 Transform;
-uniform mat4 ViewProjection;
+//per frame data, see global_render_data.h
+layout(std140, binding = 0) uniform GlobalRenderData
+{
+  mat4 ViewProjection;
+  vec3 CameraPosition;
+  vec3 LightDirection;
+  vec3 AmbientLight;
+  vec3 SunLight;
+};
+
+//transform and bone palette of every draw from the ring buffer, see render_queue.h
+layout(std430, binding = 2) readonly buffer DrawData
+{
+  mat4 Matrices[];
+};
+layout(std430, binding = 3) readonly buffer DrawFirstMatrix
+{
+  uint FirstMatrix[];
+};
 
 layout(location = 0) in vec3 Position;
 layout(location = 1) in vec3 Normal;
 layout(location = 2) in vec2 UV;
 layout(location = 3) in vec4 BoneWeights;
 layout(location = 4) in uvec4 BoneIndex;
+//zero unless the mesh has morph targets, see morph_targets.h
+layout(location = 5) in vec3 MorphPosition;
+layout(location = 6) in vec3 MorphNormal;
+//base instance of the draw, see geometry_pool.h
+layout(location = 7) in uint DrawIndex;
 
 out VsOutput vsOutput;
 
 void main() {
 
-  vec3 VertexPosition = (Transform * vec4(Position, 1)).xyz;
-  vsOutput.EyespaceNormal = (Transform * vec4(Normal, 0)).xyz;
+  uint First = FirstMatrix[DrawIndex];
+  mat4 Transform = Matrices[First];
+  uvec4 Bones = BoneIndex + First + 1;
+  mat4 BoneTransform =
+    Matrices[Bones.x] * BoneWeights.x +
+    Matrices[Bones.y] * BoneWeights.y +
+    Matrices[Bones.z] * BoneWeights.z +
+    Matrices[Bones.w] * BoneWeights.w;
+  mat4 SkinnedTransform = Transform * BoneTransform;
+
+  vec3 VertexPosition = (SkinnedTransform * vec4(Position + MorphPosition, 1)).xyz;
+  vsOutput.EyespaceNormal = (SkinnedTransform * vec4(Normal + MorphNormal, 0)).xyz;
 
   gl_Position = ViewProjection * vec4(VertexPosition, 1);
   vsOutput.WorldPosition = VertexPosition;
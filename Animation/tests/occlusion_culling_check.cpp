@@ -0,0 +1,134 @@
+#include <occlusion_culling.h>
+#include <job_system.h>
+#include <cstdio>
+#include <random>
+
+//the same face list as occlusion_culling.cpp, the reference draws both sides of every box
+static const int BoxTriangles[12][3] = {
+  {0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6},
+  {0, 1, 5}, {0, 5, 4}, {2, 6, 7}, {2, 7, 3},
+  {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+
+static vec3 box_corner(const BoundingBox &box, int i)
+{
+  return vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+}
+
+//false if the corner is behind the near plane, like the rasterizer
+static bool project(const mat4 &transform, const vec3 &p, vec3 &screen)
+{
+  vec4 clip = transform * vec4(p, 1.f);
+  if (clip.w < 1e-3f || clip.z < -clip.w)
+    return false;
+  vec3 ndc = vec3(clip) / clip.w;
+  screen = vec3((ndc.x * 0.5f + 0.5f) * OcclusionWidth, (ndc.y * 0.5f + 0.5f) * OcclusionHeight, ndc.z * 0.5f + 0.5f);
+  return true;
+}
+
+//per pixel barycentric test of all triangles without face culling
+static void rasterize_reference(const std::vector<mat4> &transforms, const std::vector<BoundingBox> &boxes, std::vector<float> &depth)
+{
+  depth.assign(OcclusionWidth * OcclusionHeight, 1.f);
+  for (size_t k = 0; k < boxes.size(); k++)
+  {
+    vec3 screen[8];
+    bool inFront = true;
+    for (int i = 0; i < 8; i++)
+      inFront = inFront && project(transforms[k], box_corner(boxes[k], i), screen[i]);
+    if (!inFront)
+      continue;
+    for (const int *triangle : BoxTriangles)
+    {
+      vec3 a = screen[triangle[0]], b = screen[triangle[1]], c = screen[triangle[2]];
+      float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+      if (area == 0.f)
+        continue;
+      for (int y = 0; y < OcclusionHeight; y++)
+        for (int x = 0; x < OcclusionWidth; x++)
+        {
+          vec2 p(x + 0.5f, y + 0.5f);
+          float wa = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+          float wb = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+          float wc = 1.f - wa - wb;
+          if (wa < 0.f || wb < 0.f || wc < 0.f)
+            continue;
+          float &d = depth[y * OcclusionWidth + x];
+          d = glm::min(d, wa * a.z + wb * b.z + wc * c.z);
+        }
+    }
+  }
+}
+
+//an occluded box must be behind the reference depth at every pixel under its screen rect
+static bool really_occluded(const mat4 &view_projection, const BoundingBox &box, const std::vector<float> &depth)
+{
+  vec3 lo = vec3(FLT_MAX), hi = vec3(-FLT_MAX);
+  for (int i = 0; i < 8; i++)
+  {
+    vec3 screen;
+    if (!project(view_projection, box_corner(box, i), screen))
+      return false;
+    lo = glm::min(lo, screen);
+    hi = glm::max(hi, screen);
+  }
+  for (int y = glm::max(int(lo.y), 0); y <= glm::min(int(hi.y), OcclusionHeight - 1); y++)
+    for (int x = glm::max(int(lo.x), 0); x <= glm::min(int(hi.x), OcclusionWidth - 1); x++)
+      if (depth[y * OcclusionWidth + x] >= lo.z)
+        return false;
+  return true;
+}
+
+int main()
+{
+  init_job_system();
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> position(-20.f, 20.f), size(0.2f, 2.f), angle(0.f, 6.28f);
+  mat4 viewProjection = glm::perspective(1.f, 2.f, 0.1f, 500.f) * glm::lookAt(vec3(0.f, 3.f, -30.f), vec3(0.f), vec3(0.f, 1.f, 0.f));
+
+  //rotated boxes, every 7th one is mirrored to check the winding flip
+  OcclusionBuffer buffer;
+  begin_occlusion_frame(buffer, viewProjection);
+  std::vector<mat4> transforms;
+  std::vector<BoundingBox> boxes;
+  for (int i = 0; i < 300; i++)
+  {
+    vec3 axis = normalize(vec3(position(rng), position(rng), position(rng)));
+    mat4 transform = glm::translate(mat4(1.f), vec3(position(rng), position(rng) * 0.2f, position(rng))) * glm::rotate(mat4(1.f), angle(rng), axis);
+    if (i % 7 == 0)
+      transform = glm::scale(transform, vec3(-1.f, 1.f, 1.f));
+    vec3 extent = vec3(size(rng), size(rng), size(rng));
+    transforms.push_back(viewProjection * transform);
+    boxes.push_back(BoundingBox{-extent, extent});
+    add_occluder(buffer, transform, boxes.back());
+  }
+  rasterize_occluders(buffer);
+
+  std::vector<float> reference;
+  rasterize_reference(transforms, boxes, reference);
+  int mismatched = 0, covered = 0;
+  for (int i = 0; i < OcclusionWidth * OcclusionHeight; i++)
+  {
+    covered += reference[i] < 1.f;
+    mismatched += glm::abs(reference[i] - buffer.depth[i]) > 1e-4f;
+  }
+
+  int occluded = 0, wrong = 0;
+  for (int i = 0; i < 2000; i++)
+  {
+    vec3 center = vec3(position(rng), position(rng) * 0.2f, position(rng) + 15.f);
+    vec3 extent = vec3(size(rng) * 0.3f);
+    BoundingBox box{center - extent, center + extent};
+    if (is_occluded(buffer, box))
+    {
+      occluded++;
+      wrong += !really_occluded(viewProjection, box, reference);
+    }
+  }
+  close_job_system();
+
+  printf("covered pixels %d, mismatched %d, occluded boxes %d of 2000, wrongly occluded %d\n", covered, mismatched, occluded, wrong);
+  //the scene must exercise both checks
+  bool passed = covered > 0 && occluded > 0 && mismatched == 0 && wrong == 0;
+  printf(passed ? "passed\n" : "failed\n");
+  return passed ? 0 : 1;
+}
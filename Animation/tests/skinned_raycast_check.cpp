@@ -0,0 +1,43 @@
+#include <skinned_raycast.h>
+#include <cstdio>
+#include <limits>
+
+struct RayCase
+{
+  const char *name;
+  vec3 origin, direction;
+  float maxDistance;
+  bool expected;
+};
+
+int main()
+{
+  //one capsule along x on joint 0, the palette moves it to x = 10
+  SkinnedRaycastModel model;
+  model.capsules.push_back(JointCapsule{0, vec3(-1.f, 0.f, 0.f), vec3(1.f, 0.f, 0.f), 0.5f});
+  model.capsuleBindPose.push_back(mat4(1.f));
+  mat4 palette = translate(mat4(1.f), vec3(10.f, 0.f, 0.f));
+
+  const float infinity = std::numeric_limits<float>::infinity();
+  const RayCase cases[] = {
+    {"flt_max", vec3(0.f, 0.f, -5.f), normalize(vec3(10.f, 0.f, 5.f)), FLT_MAX, true},
+    {"infinity", vec3(0.f, 0.f, -5.f), normalize(vec3(10.f, 0.f, 5.f)), infinity, true},
+    {"unnormalized flt_max", vec3(0.f, 0.f, -5.f), vec3(10.f, 0.f, 5.f), FLT_MAX, true},
+    {"flt_max miss", vec3(0.f, 0.f, -5.f), normalize(vec3(10.f, 2.f, 5.f)), FLT_MAX, false},
+    {"flt_max behind", vec3(0.f, 0.f, -5.f), -normalize(vec3(10.f, 0.f, 5.f)), FLT_MAX, false},
+    {"too short", vec3(0.f, 0.f, -5.f), normalize(vec3(10.f, 0.f, 5.f)), 5.f, false},
+    {"nan", vec3(0.f, 0.f, -5.f), normalize(vec3(10.f, 0.f, 5.f)), std::numeric_limits<float>::quiet_NaN(), false}};
+
+  int failed = 0;
+  for (const RayCase &c : cases)
+  {
+    bool hit = raycast_joint_capsules(model, &palette, c.origin, c.direction, c.maxDistance);
+    if (hit != c.expected)
+    {
+      printf("%s: hit %d, expected %d\n", c.name, hit, c.expected);
+      failed++;
+    }
+  }
+  printf(failed == 0 ? "passed\n" : "failed\n");
+  return failed == 0 ? 0 : 1;
+}